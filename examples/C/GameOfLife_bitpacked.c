@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "life_random.h"
+/**
+ * Game of Life with 64 cells per 64-bit word
+ *
+ * Bit j of the word k of a row is the cell of column 64*k+j. Each row has an
+ * empty word on both sides and the world has an empty row above and below, so
+ * the border of the world is a dead zone as in GameOfLife_solution.c.
+ * The number of neighbours of the 64 cells of a word is computed at once with
+ * bitwise adders. The initial state is the same as GameOfLife_solution.c.
+ *
+ * Usage: ./GameOfLife_bitpacked rows cols generations
+ *
+ * List of functions:
+ *   - uint64_t* allocate(int rows, int cols)
+ *   - void fill_world(uint64_t* world, int rows, int cols)
+ *   - long next(uint64_t* world, const uint64_t* oworld, int rows, int cols)
+ *     compute the next generation and return the number of cells alive
+ *   - long alive(const uint64_t* world, int rows, int cols)
+ */
+
+// Number of words in a row, including the empty word on both sides
+#define STRIDE(cols) (((size_t) (cols)+63)/64 + 2)
+
+uint64_t* allocate(int rows, int cols)
+{
+    /**
+     * Allocate a world filled with dead cells
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @return a pointer to the world
+     */
+    return (uint64_t*) calloc((size_t) (rows+2)*STRIDE(cols), sizeof(uint64_t));
+}
+
+void fill_world(uint64_t* restrict world, int rows, int cols)
+{
+    /**
+     * Set the initial state of the world (same random sequence as GameOfLife_solution.c)
+     * @param world: a pointer to the storage for the current step
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     */
+    const size_t stride = STRIDE(cols);
+    for (int r=1; r <= rows; ++r)
+    {
+        uint64_t state = row_generator(r-1);
+        for (int c=0; c < cols; ++c)
+            if (random_cell(&state))
+                world[r*stride + 1 + c/64] |= (uint64_t) 1 << (c%64);
+    }
+}
+
+long next(uint64_t* restrict world, const uint64_t* restrict oworld, int rows, int cols)
+{
+    /**
+     * Apply the rules and compute the next generation
+     * @param world: a pointer to the storage for the next step
+     * @param oworld: a pointer to the storage for the current step
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @return the number of cells alive in the next generation
+     */
+    const size_t stride = STRIDE(cols);
+    const size_t words = stride-2;
+    // Cells of the last word beyond the last column stay dead
+    const uint64_t last_mask = cols%64 ? ((uint64_t) 1 << (cols%64)) - 1 : ~(uint64_t) 0;
+    long cells = 0;
+#pragma omp parallel for reduction(+:cells) schedule(static)
+    for (int r=1; r <= rows; ++r)
+    {
+        const uint64_t* above = oworld + (r-1)*stride;
+        const uint64_t* current = oworld + r*stride;
+        const uint64_t* below = oworld + (r+1)*stride;
+        uint64_t* out = world + r*stride;
+#pragma omp simd reduction(+:cells)
+        for (size_t k=1; k <= words; ++k)
+        {
+            // Neighbours in the west (column-1) and east (column+1) directions
+            uint64_t aw = (above[k] << 1) | (above[k-1] >> 63);
+            uint64_t ae = (above[k] >> 1) | (above[k+1] << 63);
+            uint64_t bw = (below[k] << 1) | (below[k-1] >> 63);
+            uint64_t be = (below[k] >> 1) | (below[k+1] << 63);
+            uint64_t cw = (current[k] << 1) | (current[k-1] >> 63);
+            uint64_t ce = (current[k] >> 1) | (current[k+1] << 63);
+            // Number of neighbours in each row: sum + 2*carry
+            uint64_t sa = aw ^ above[k] ^ ae;
+            uint64_t ca = (aw & above[k]) | (ae & (aw ^ above[k]));
+            uint64_t sb = bw ^ below[k] ^ be;
+            uint64_t cb = (bw & below[k]) | (be & (bw ^ below[k]));
+            uint64_t sc = cw ^ ce;
+            uint64_t cc = cw & ce;
+            // neighbours = ones + 2*(twos + carry_ones)
+            uint64_t ones = sa ^ sb ^ sc;
+            uint64_t carry_ones = (sa & sb) | (sc & (sa ^ sb));
+            uint64_t twos = ca ^ cb ^ cc;
+            uint64_t fours = (ca & cb) | (cc & (ca ^ cb));
+            // 2 or 3 neighbours <=> twos + carry_ones == 1
+            uint64_t two_or_three = ~fours & (twos ^ carry_ones);
+            uint64_t cell = two_or_three & (ones | current[k]);
+            if (k == words)
+                cell &= last_mask;
+            out[k] = cell;
+            cells += __builtin_popcountll(cell);
+        }
+    }
+    return cells;
+}
+
+long alive(const uint64_t* restrict world, int rows, int cols)
+{
+    /**
+     * Compute the number of cells alive at the current generation
+     * @param world: a pointer to the storage for the current step
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     */
+    const size_t stride = STRIDE(cols);
+    long cells = 0;
+#pragma omp parallel for reduction(+:cells) schedule(static)
+    for (int r=1; r <= rows; ++r)
+        for (size_t k=1; k < stride-1; ++k)
+            cells += __builtin_popcountll(world[r*stride + k]);
+    return cells;
+}
+
+int main(int argc, char** argv)
+{
+    int rows, cols, generations;
+    uint64_t* world;
+    uint64_t* oworld;
+    struct timespec end, start;
+
+    if (argc < 4)
+    {
+        printf("Wrong number of arguments: Please give rows cols and generations\n");
+        return 1;
+    }
+    rows = strtol(argv[1], NULL, 10);
+    cols = strtol(argv[2], NULL, 10);
+    generations = strtol(argv[3], NULL, 10);
+
+    world = allocate(rows, cols);
+    oworld = allocate(rows, cols);
+    if (world == NULL || oworld == NULL)
+    {
+        printf("Not enough memory for a world of %d x %d cells\n", rows, cols);
+        return 1;
+    }
+    fill_world(world, rows, cols);
+    printf("Initial state set\n");
+    printf("Cells alive at generation %d: %ld\n", 0, alive(world, rows, cols));
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for (int g=1; g <= generations; ++g)
+    {
+        // The new generation is written in the other buffer
+        uint64_t* tmp = oworld;
+        oworld = world;
+        world = tmp;
+        long cells = next(world, oworld, rows, cols);
+        printf("Cells alive at generation %4d: %ld\n", g, cells);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.e9;
+    printf("The time to compute %d generations was %10.5e s (%.3f Gcells/s)\n", generations,
+           seconds, (double) rows * cols * generations / seconds / 1.e9);
+
+    free(world);
+    free(oworld);
+
+    return 0;
+}
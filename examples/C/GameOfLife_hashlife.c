@@ -0,0 +1,658 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "mmap_io.h"
+#include "life_random.h"
+/**
+ * Game of Life with the Hashlife algorithm
+ *
+ * The world is a quadtree: a node of level k is a square of 2^k x 2^k cells
+ * made of 4 nodes of level k-1, the nodes of level 0 being the dead and the
+ * living cell. Identical squares are the same node (hash consing), so a
+ * structured pattern needs few nodes. The result of a node of level k >= 2 is
+ * its centre (level k-1) advanced 2^min(step, k-2) generations. It is computed
+ * from the results of smaller nodes and memoised in the node: advancing
+ * a pattern by millions of generations reuses the results computed for the
+ * repeated parts of space and time.
+ *
+ * The world of this engine is the infinite plane, while the world of
+ * GameOfLife_solution.c has a dead border: both give the same generations as
+ * long as the pattern does not reach the border (see the check mode). The
+ * dense world (int*, rows+2 x cols+2 with the border) is imported as the
+ * initial state and the final state is exported to the same layout, the
+ * cells out of the rows x cols window being dropped.
+ *
+ * The number of nodes is kept under MAX_NODES by a garbage collection
+ * between two steps: the nodes which cannot be reached from the root are
+ * freed, then the memoised results too if it is not enough.
+ *
+ * Usage: ./GameOfLife_hashlife rows cols generations [interval] [init.gray]
+ *          advance the world (random as GameOfLife_solution.c or read from
+ *          a .gray file) and print the population every interval generations.
+ *          The final rows x cols window is written to hashlife.gray
+ *        ./GameOfLife_hashlife check rows cols generations
+ *          compare with the dense kernel on a world large enough for the
+ *          random pattern never to reach the border
+ *
+ * List of functions:
+ *   - node* join(node* nw, node* ne, node* sw, node* se)
+ *     the unique node made of 4 nodes
+ *   - node* advance(node* n)
+ *     the centre of n advanced 2^min(step, level-2) generations (memoised)
+ *   - void universe_import(const int* world, int rows, int cols)
+ *   - void universe_export(int* world, int rows, int cols)
+ *   - void universe_step(int log2_generations)
+ *     advance the universe 2^log2_generations generations
+ *   - void collect_garbage(void)
+ */
+
+// Soft bound on the number of nodes between two steps
+#ifndef MAX_NODES
+#define MAX_NODES (1 << 22)
+#endif
+// Number of nodes allocated at once
+#define NODE_CHUNK (1 << 16)
+#define MAX_LEVEL 64
+#define MIN(a,b) ( ((a)<(b))?(a):(b) )
+
+typedef struct node
+{
+    struct node* nw;
+    struct node* ne;
+    struct node* sw;
+    struct node* se;
+    // Memoised centre after 2^rstep generations, NULL if not computed
+    struct node* result;
+    // Next node in the same bucket of the hash table or in the free list
+    struct node* next;
+    uint64_t population;
+    // Level of the node, -1 for a free node
+    int8_t level;
+    int8_t rstep;
+    uint8_t mark;
+} node;
+
+// Table of the nodes in use
+node** table = NULL;
+size_t table_size = 0;
+size_t nodes = 0;
+node* free_list = NULL;
+node** chunks = NULL;
+size_t nchunks = 0;
+size_t collections = 0;
+// The cells and the empty squares of each level
+node dead = {.level = 0, .population = 0};
+node living = {.level = 0, .population = 1};
+node* empty_nodes[MAX_LEVEL];
+// Current step: the results advance 2^step generations (at most)
+int step = 0;
+// The universe: root node, coordinates of its top left cell and generation
+node* root = NULL;
+int64_t root_x = 0;
+int64_t root_y = 0;
+uint64_t generation = 0;
+
+size_t hash(const node* nw, const node* ne, const node* sw, const node* se)
+{
+    /**
+     * Hash of the 4 children of a node
+     */
+    uint64_t h = (uintptr_t) nw;
+    h = h*0x9e3779b97f4a7c15ull + (uintptr_t) ne;
+    h = h*0x9e3779b97f4a7c15ull + (uintptr_t) sw;
+    h = h*0x9e3779b97f4a7c15ull + (uintptr_t) se;
+    return (size_t) (h ^ (h >> 29));
+}
+
+void table_insert(node* n)
+{
+    /**
+     * Insert a node in the hash table (no check for duplicates)
+     */
+    size_t h = hash(n->nw, n->ne, n->sw, n->se) & (table_size-1);
+    n->next = table[h];
+    table[h] = n;
+}
+
+void table_resize(size_t size)
+{
+    /**
+     * Change the number of buckets of the hash table (a power of 2)
+     */
+    node** old = table;
+    size_t old_size = table_size;
+    table = (node**) calloc(size, sizeof(node*));
+    table_size = size;
+    for (size_t i=0; i < old_size; ++i)
+        for (node* n=old[i]; n != NULL; )
+        {
+            node* next = n->next;
+            table_insert(n);
+            n = next;
+        }
+    free(old);
+}
+
+node* new_node(void)
+{
+    /**
+     * Take a node from the free list, allocating a new chunk if needed
+     * The nodes never move: the pointers stay valid until the node is freed.
+     */
+    if (free_list == NULL)
+    {
+        node* chunk = (node*) malloc(NODE_CHUNK*sizeof(node));
+        if (chunk == NULL)
+        {
+            fprintf(stderr, "Error: not enough memory for %zu nodes\n", nodes+NODE_CHUNK);
+            exit(1);
+        }
+        chunks = (node**) realloc(chunks, (nchunks+1)*sizeof(node*));
+        chunks[nchunks++] = chunk;
+        for (size_t i=0; i < NODE_CHUNK; ++i)
+        {
+            chunk[i].level = -1;
+            chunk[i].next = i+1 < NODE_CHUNK ? &chunk[i+1] : NULL;
+        }
+        free_list = chunk;
+    }
+    node* n = free_list;
+    free_list = n->next;
+    return n;
+}
+
+node* join(node* nw, node* ne, node* sw, node* se)
+{
+    /**
+     * Return the node made of 4 nodes of the same level, creating it only
+     * if it does not exist yet
+     */
+    size_t h = hash(nw, ne, sw, se) & (table_size-1);
+    for (node* n=table[h]; n != NULL; n = n->next)
+        if (n->nw == nw && n->ne == ne && n->sw == sw && n->se == se)
+            return n;
+    node* n = new_node();
+    n->nw = nw;
+    n->ne = ne;
+    n->sw = sw;
+    n->se = se;
+    n->result = NULL;
+    n->population = nw->population + ne->population + sw->population + se->population;
+    n->level = nw->level+1;
+    n->rstep = -1;
+    n->mark = 0;
+    n->next = table[h];
+    table[h] = n;
+    if (++nodes > table_size)
+        table_resize(2*table_size);
+    return n;
+}
+
+node* empty(int level)
+{
+    /**
+     * The square of 2^level x 2^level dead cells
+     */
+    if (empty_nodes[level] == NULL)
+    {
+        node* e = empty(level-1);
+        empty_nodes[level] = join(e, e, e, e);
+    }
+    return empty_nodes[level];
+}
+
+node* center(node* n)
+{
+    /**
+     * The centre of a node (level k-1)
+     */
+    return join(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+node* center_horizontal(node* w, node* e)
+{
+    /**
+     * The node of level k-1 centred between two nodes of level k-1 side by side
+     */
+    return join(w->ne, e->nw, w->se, e->sw);
+}
+
+node* center_vertical(node* n, node* s)
+{
+    /**
+     * The node of level k-1 centred between two nodes of level k-1 one above the other
+     */
+    return join(n->sw, n->se, s->nw, s->ne);
+}
+
+node* base(node* n)
+{
+    /**
+     * Apply the rules to the centre of a node of level 2 (4x4 cells)
+     * @return the node of level 1 with the 2x2 cells of the next generation
+     */
+    int cells[4][4];
+    node* quadrants[2][2] = {{n->nw, n->ne}, {n->sw, n->se}};
+    for (int y=0; y < 4; ++y)
+        for (int x=0; x < 4; ++x)
+        {
+            node* q = quadrants[y/2][x/2];
+            node* sub[2][2] = {{q->nw, q->ne}, {q->sw, q->se}};
+            cells[y][x] = (int) sub[y%2][x%2]->population;
+        }
+    node* next[2][2];
+    for (int y=1; y < 3; ++y)
+        for (int x=1; x < 3; ++x)
+        {
+            int neigh = cells[y-1][x-1] + cells[y-1][x] + cells[y-1][x+1]
+                      + cells[y][x-1]                   + cells[y][x+1]
+                      + cells[y+1][x-1] + cells[y+1][x] + cells[y+1][x+1];
+            int cell = neigh == 3 || (cells[y][x] == 1 && neigh == 2);
+            next[y-1][x-1] = cell ? &living : &dead;
+        }
+    return join(next[0][0], next[0][1], next[1][0], next[1][1]);
+}
+
+node* advance(node* n)
+{
+    /**
+     * Compute the centre of a node of level k >= 2 advanced 2^min(step, k-2)
+     * generations
+     * The node is split in 9 overlapping nodes of level k-1. In the first
+     * stage they are advanced (or only reduced to their centre if the step is
+     * smaller than 2^(k-2) generations), in the second stage the 4 nodes
+     * of level k-1 assembled from the 9 results are advanced.
+     * @param n: a node of level 2 or more
+     * @return the centre of n (level k-1) in the future
+     */
+    const int rstep = MIN(step, n->level-2);
+    if (n->result != NULL && n->rstep == rstep)
+        return n->result;
+    node* r;
+    if (n->population == 0)
+        r = empty(n->level-1);
+    else if (n->level == 2)
+        r = base(n);
+    else
+    {
+        node* n00 = n->nw;
+        node* n01 = center_horizontal(n->nw, n->ne);
+        node* n02 = n->ne;
+        node* n10 = center_vertical(n->nw, n->sw);
+        node* n11 = center(n);
+        node* n12 = center_vertical(n->ne, n->se);
+        node* n20 = n->sw;
+        node* n21 = center_horizontal(n->sw, n->se);
+        node* n22 = n->se;
+        node* (*first_stage)(node*) = rstep == n->level-2 ? advance : center;
+        node* r00 = first_stage(n00);
+        node* r01 = first_stage(n01);
+        node* r02 = first_stage(n02);
+        node* r10 = first_stage(n10);
+        node* r11 = first_stage(n11);
+        node* r12 = first_stage(n12);
+        node* r20 = first_stage(n20);
+        node* r21 = first_stage(n21);
+        node* r22 = first_stage(n22);
+        r = join(advance(join(r00, r01, r10, r11)), advance(join(r01, r02, r11, r12)),
+                 advance(join(r10, r11, r20, r21)), advance(join(r11, r12, r21, r22)));
+    }
+    n->result = r;
+    n->rstep = rstep;
+    return r;
+}
+
+void mark(node* n, int keep_results)
+{
+    /**
+     * Mark the nodes reachable from n (and from its memoised results)
+     */
+    if (n == NULL || n->level == 0 || n->mark)
+        return;
+    n->mark = 1;
+    mark(n->nw, keep_results);
+    mark(n->ne, keep_results);
+    mark(n->sw, keep_results);
+    mark(n->se, keep_results);
+    if (keep_results)
+        mark(n->result, keep_results);
+}
+
+void sweep(int keep_results)
+{
+    /**
+     * Free the nodes which are not marked and rebuild the hash table with
+     * the other ones
+     */
+    memset(table, 0, table_size*sizeof(node*));
+    free_list = NULL;
+    nodes = 0;
+    for (size_t c=0; c < nchunks; ++c)
+        for (size_t i=0; i < NODE_CHUNK; ++i)
+        {
+            node* n = &chunks[c][i];
+            if (n->level > 0 && n->mark)
+            {
+                n->mark = 0;
+                if (!keep_results)
+                    n->result = NULL;
+                table_insert(n);
+                ++nodes;
+            }
+            else
+            {
+                n->level = -1;
+                n->next = free_list;
+                free_list = n;
+            }
+        }
+}
+
+void collect_garbage(void)
+{
+    /**
+     * Free the nodes which are not needed by the root, keeping the
+     * memoised results if they fit in half of MAX_NODES
+     */
+    for (int keep_results=1; keep_results >= 0; --keep_results)
+    {
+        mark(root, keep_results);
+        for (int l=0; l < MAX_LEVEL; ++l)
+            mark(empty_nodes[l], keep_results);
+        sweep(keep_results);
+        ++collections;
+        if (nodes <= MAX_NODES/2)
+            break;
+    }
+}
+
+void universe_init(void)
+{
+    /**
+     * Create the tables of the nodes
+     */
+    table_resize(1 << 16);
+    memset(empty_nodes, 0, sizeof(empty_nodes));
+    empty_nodes[0] = &dead;
+}
+
+void universe_free(void)
+{
+    for (size_t c=0; c < nchunks; ++c)
+        free(chunks[c]);
+    free(chunks);
+    free(table);
+}
+
+node* build(const int* restrict world, int rows, int cols, int level, int x, int y)
+{
+    /**
+     * Build the node of the square of 2^level cells whose top left cell is (x, y)
+     */
+    if (x >= cols || y >= rows)
+        return empty(level);
+    if (level == 0)
+        return world[(size_t) (y+1)*(cols+2) + x+1] ? &living : &dead;
+    int half = 1 << (level-1);
+    return join(build(world, rows, cols, level-1, x, y), build(world, rows, cols, level-1, x+half, y),
+                build(world, rows, cols, level-1, x, y+half),
+                build(world, rows, cols, level-1, x+half, y+half));
+}
+
+void universe_import(const int* restrict world, int rows, int cols)
+{
+    /**
+     * Set the universe from a dense world
+     * The cell (r, c) of the world (1 <= r <= rows, 1 <= c <= cols) is the
+     * cell (x, y) = (c-1, r-1) of the universe.
+     * @param world: a pointer to the world with its border
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     */
+    int level = 3;
+    while ((1 << level) < rows || (1 << level) < cols)
+        ++level;
+    root = build(world, rows, cols, level, 0, 0);
+    root_x = 0;
+    root_y = 0;
+    generation = 0;
+}
+
+void extract(node* n, int64_t x, int64_t y, int* restrict world, int rows, int cols)
+{
+    /**
+     * Copy the living cells of node n, whose top left cell is (x, y), which
+     * are inside the window of the dense world
+     */
+    const int64_t size = (int64_t) 1 << n->level;
+    if (n->population == 0 || x >= cols || y >= rows || x+size <= 0 || y+size <= 0)
+        return;
+    if (n->level == 0)
+    {
+        world[(size_t) (y+1)*(cols+2) + x+1] = 1;
+        return;
+    }
+    extract(n->nw, x, y, world, rows, cols);
+    extract(n->ne, x+size/2, y, world, rows, cols);
+    extract(n->sw, x, y+size/2, world, rows, cols);
+    extract(n->se, x+size/2, y+size/2, world, rows, cols);
+}
+
+void universe_export(int* restrict world, int rows, int cols, int64_t x, int64_t y)
+{
+    /**
+     * Copy a window of the universe into a dense world
+     * The cell (r, c) of the world is the cell (x+c-1, y+r-1) of the universe,
+     * the border of the world is dead.
+     * @param world: a pointer to the world with its border
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @param x, y: the cell of the universe at the top left of the window
+     */
+    memset(world, 0, (size_t) (rows+2)*(cols+2)*sizeof(int));
+    extract(root, root_x-x, root_y-y, world, rows, cols);
+}
+
+node* expand(node* n)
+{
+    /**
+     * The node of level k+1 with n at its centre and dead cells around
+     */
+    node* e = empty(n->level-1);
+    return join(join(e, e, e, n->nw), join(e, e, n->ne, e),
+                join(e, n->sw, e, e), join(n->se, e, e, e));
+}
+
+void universe_step(int log2_generations)
+{
+    /**
+     * Advance the universe 2^log2_generations generations
+     * The root is expanded until the pattern lies in its central quarter
+     * and the root is at least 3 levels above the step: the pattern cannot
+     * go out of the result, the centre of the root.
+     */
+    step = log2_generations;
+    for (;;)
+    {
+        const uint64_t inner = root->nw->se->se->population + root->ne->sw->sw->population
+                             + root->sw->ne->ne->population + root->se->nw->nw->population;
+        if (root->level >= step+3 && inner == root->population)
+            break;
+        const int64_t size = (int64_t) 1 << root->level;
+        root = expand(root);
+        root_x -= size/2;
+        root_y -= size/2;
+    }
+    const int64_t size = (int64_t) 1 << root->level;
+    root = advance(root);
+    root_x += size/4;
+    root_y += size/4;
+    generation += (uint64_t) 1 << step;
+    if (nodes > MAX_NODES)
+        collect_garbage();
+}
+
+void universe_advance(uint64_t generations)
+{
+    /**
+     * Advance the universe any number of generations, one power of 2 at a time
+     */
+    for (int b=63; b >= 0; --b)
+        if (generations & ((uint64_t) 1 << b))
+            universe_step(b);
+}
+
+void fill_world(int* restrict world, int rows, int cols)
+{
+    /**
+     * Set the initial state of the world (same random sequence as GameOfLife_solution.c)
+     */
+    memset(world, 0, (size_t) (rows+2)*(cols+2)*sizeof(int));
+    for (int r=1; r <= rows; ++r)
+    {
+        uint64_t state = row_generator(r-1);
+        for (int c=1; c <= cols; ++c)
+            world[r*(cols+2) + c] = random_cell(&state);
+    }
+}
+
+double elapsed(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.e9;
+}
+
+// Number of living neighbours and rules of the game, for the check mode
+#define STENCIL_NAME life
+#define STENCIL_TYPE int
+#define STENCIL_RADIUS 1
+#define STENCIL_CHANNELS 1
+#define STENCIL_COEFS { {1, 1, 1}, \
+                        {1, 0, 1}, \
+                        {1, 1, 1}}
+#define STENCIL_FINALIZE(neigh, cell) ((neigh) == 3 || ((cell) == 1 && (neigh) == 2))
+#define STENCIL_HOST
+#include "stencil.h"
+
+int check(int rows, int cols, int generations)
+{
+    /**
+     * Compare Hashlife with the dense kernel for a random pattern
+     * The dense world has a margin of generations+1 dead cells around the
+     * pattern so the pattern never reaches its border.
+     * @return 0 if the worlds are identical
+     */
+    struct timespec end, start;
+    const int margin = generations+1;
+    const int drows = rows+2*margin;
+    const int dcols = cols+2*margin;
+    const size_t size = (size_t) (drows+2)*(dcols+2);
+    int* pattern = (int*) malloc((size_t) (rows+2)*(cols+2)*sizeof(int));
+    int* world = (int*) calloc(size, sizeof(int));
+    int* oworld = (int*) calloc(size, sizeof(int));
+    int* result = (int*) malloc(size*sizeof(int));
+
+    fill_world(pattern, rows, cols);
+    for (int r=1; r <= rows; ++r)
+        memcpy(world + (size_t) (r+margin)*(dcols+2) + margin+1, pattern + (size_t) r*(cols+2) + 1,
+               cols*sizeof(int));
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for (int g=1; g <= generations; ++g)
+    {
+        int* tmp = oworld;
+        oworld = world;
+        world = tmp;
+        life(oworld, world, drows+2, dcols+2);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("Dense kernel: %10.5e s\n", elapsed(start, end));
+
+    universe_import(pattern, rows, cols);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    universe_advance(generations);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("Hashlife:     %10.5e s, %zu nodes\n", elapsed(start, end), nodes);
+    universe_export(result, drows, dcols, -margin, -margin);
+
+    int status = memcmp(world, result, size*sizeof(int)) != 0;
+    printf("The worlds after %d generations are %s, %llu cells alive\n", generations,
+           status ? "DIFFERENT" : "identical", (unsigned long long) root->population);
+    free(pattern);
+    free(world);
+    free(oworld);
+    free(result);
+    return status;
+}
+
+int main(int argc, char** argv)
+{
+    struct timespec end, start;
+
+    if (argc < 4)
+    {
+        printf("Wrong number of arguments: Please give rows cols and generations [interval] [init.gray]\n");
+        printf("Use \"check rows cols generations\" to compare with the dense kernel\n");
+        return 1;
+    }
+    universe_init();
+    if (strcmp(argv[1], "check") == 0)
+    {
+        if (argc < 5)
+        {
+            printf("Wrong number of arguments: Please give check rows cols and generations\n");
+            return 1;
+        }
+        int status = check(strtol(argv[2], NULL, 10), strtol(argv[3], NULL, 10), strtol(argv[4], NULL, 10));
+        universe_free();
+        return status;
+    }
+    int rows = strtol(argv[1], NULL, 10);
+    int cols = strtol(argv[2], NULL, 10);
+    uint64_t generations = strtoull(argv[3], NULL, 10);
+    uint64_t interval = argc >= 5 ? strtoull(argv[4], NULL, 10) : generations;
+    if (interval == 0)
+        interval = generations > 0 ? generations : 1;
+    size_t size = (size_t) (rows+2)*(cols+2);
+    int* world = (int*) calloc(size, sizeof(int));
+
+    if (argc >= 6)
+    {
+        unsigned char* mat = map_input(argv[5], size);
+        if (mat == NULL)
+            return 1;
+        for (int r=1; r <= rows; ++r)
+            for (int c=1; c <= cols; ++c)
+                world[r*(cols+2) + c] = mat[r*(cols+2) + c] != 0;
+        unmap(mat, size);
+    }
+    else
+        fill_world(world, rows, cols);
+    universe_import(world, rows, cols);
+    printf("Cells alive at generation %d: %llu\n", 0, (unsigned long long) root->population);
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    while (generation < generations)
+    {
+        universe_advance(MIN(interval, generations-generation));
+        printf("Cells alive at generation %llu: %llu (%zu nodes, %zu garbage collections)\n",
+               (unsigned long long) generation, (unsigned long long) root->population, nodes,
+               collections);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("The time to compute %llu generations was %10.5e s\n", (unsigned long long) generations,
+           elapsed(start, end));
+
+    // The window of the initial world at the final generation
+    universe_export(world, rows, cols, 0, 0);
+    unsigned char* mat = map_output("hashlife.gray", size);
+    if (mat != NULL)
+    {
+        for (size_t i=0; i < size; ++i)
+            mat[i] = (unsigned char) world[i] * 255;
+        unmap(mat, size);
+    }
+    free(world);
+    universe_free();
+    return 0;
+}
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENACC
+  #include <openacc.h>
+#endif
+#include <mpi.h>
+#include "../../examples/C/init_openacc.h"
+#include "life_random.h"
+/**
+ * Game of Life distributed by blocks of rows over the MPI processes
+ *
+ * Each process stores its rows with a ghost row above and below. The ghost
+ * rows are exchanged with MPI_Isend/MPI_Irecv while the rows which do not
+ * need them are computed, then the first and last rows are computed. The
+ * ghost rows of the first and last processes stay dead: they are the border
+ * of the world. The initial state and the frames are the same as
+ * GameOfLife_solution.c.
+ *
+ * Usage: mpirun -np N ./GameOfLife_mpi rows cols generations [gray|none]
+ *
+ * List of functions:
+ *   - void output(unsigned char* frame, MPI_Offset start, int num_elements, int generation)
+ *     write a part of the frame of a generation with MPI-IO
+ *   - void fill_world(int* world, int cols, int first, int local_rows)
+ *   - void exchange(int* world, int local_rows, int cols, int up, int down, MPI_Request* requests)
+ *     start the exchange of the ghost rows
+ *   - int alive(int* world, int local_rows, int cols)
+ *     number of cells alive in the rows of the process
+ */
+
+// Number of living neighbours and rules of the game
+#define STENCIL_NAME life
+#define STENCIL_TYPE int
+#define STENCIL_RADIUS 1
+#define STENCIL_CHANNELS 1
+#define STENCIL_COEFS { {1, 1, 1}, \
+                        {1, 0, 1}, \
+                        {1, 1, 1}}
+#define STENCIL_FINALIZE(neigh, cell) ((neigh) == 3 || ((cell) == 1 && (neigh) == 2))
+#include "stencil.h"
+
+void output(unsigned char* frame, MPI_Offset start, int num_elements, int generation)
+{
+   MPI_File     fh;
+   char         path[80];
+
+   sprintf(path, "generation%05d.gray", generation);
+   if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_WRONLY+MPI_MODE_CREATE, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+   {
+        fprintf(stderr, "ERROR in creating output file\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+   }
+
+   MPI_File_write_at(fh, start, frame, num_elements, MPI_UNSIGNED_CHAR, MPI_STATUS_IGNORE);
+
+   MPI_File_close(&fh);
+}
+
+void fill_world(int* restrict world, int cols, int first, int local_rows)
+{
+    /**
+     * Set the initial state of the rows of the process
+     * Each row has its own generator (life_random.h): the process draws only
+     * the cells of its rows and the world is the one of GameOfLife_solution.c.
+     * @param world: a pointer to the storage for the current step
+     * @param cols: the number of columns without the border
+     * @param first: the index of the first row of the process in the world
+     * @param local_rows: the number of rows of the process
+     */
+    memset(world, 0, (size_t) (local_rows+2)*(cols+2)*sizeof(int));
+    for (int r=0; r < local_rows; ++r)
+    {
+        uint64_t state = row_generator(first+r);
+        for (int c=1; c <= cols; ++c)
+            world[(size_t) (r+1)*(cols+2) + c] = random_cell(&state);
+    }
+}
+
+void exchange(int* restrict world, int local_rows, int cols, int up, int down, MPI_Request* requests)
+{
+    /**
+     * Start the exchange of the ghost rows with the neighbours
+     * The first and last rows are sent, the ghost rows are received. The
+     * exchange is complete after MPI_Waitall on the 4 requests.
+     * @param world: a pointer to the storage for the current step
+     * @param local_rows: the number of rows of the process
+     * @param cols: the number of columns without the border
+     * @param up, down: the ranks of the neighbours or MPI_PROC_NULL
+     * @param requests: the 4 requests of the exchange
+     */
+    const int stride = cols+2;
+#pragma acc host_data use_device(world)
+    {
+        MPI_Irecv(world, stride, MPI_INT, up, 0, MPI_COMM_WORLD, &requests[0]);
+        MPI_Irecv(world + (size_t) (local_rows+1)*stride, stride, MPI_INT, down, 1, MPI_COMM_WORLD, &requests[1]);
+        MPI_Isend(world + stride, stride, MPI_INT, up, 1, MPI_COMM_WORLD, &requests[2]);
+        MPI_Isend(world + (size_t) local_rows*stride, stride, MPI_INT, down, 0, MPI_COMM_WORLD, &requests[3]);
+    }
+}
+
+int alive(int* restrict world, int local_rows, int cols)
+{
+    /**
+     * Compute the number of cells alive in the rows of the process
+     * @param world: a pointer to the storage for the current step
+     * @param local_rows: the number of rows of the process
+     * @param cols: the number of columns without the border
+     */
+    int cells = 0;
+#ifdef _OPENACC
+#pragma acc parallel loop collapse(2) reduction(+:cells) present(world[:(local_rows+2)*(cols+2)])
+#else
+#pragma omp parallel for reduction(+:cells)
+#endif
+    for (int r=1; r <= local_rows; ++r)
+        for (int c=1; c <= cols; ++c)
+            cells += world[r*(cols+2) + c];
+    return cells;
+}
+
+int main(int argc, char** argv)
+{
+    #ifdef _OPENACC
+    acc_info info = initialisation_openacc();
+    #endif
+    MPI_Init(&argc, &argv);
+    int rank;
+    int nb_procs;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nb_procs);
+
+    if (argc < 4)
+    {
+        if (rank == 0)
+            printf("Wrong number of arguments: Please give rows cols and generations [gray|none]\n");
+        MPI_Finalize();
+        return 1;
+    }
+    int rows = atoi(argv[1]);
+    int cols = atoi(argv[2]);
+    int generations = atoi(argv[3]);
+    int frames = argc < 5 || strcmp(argv[4], "none") != 0;
+
+    // The first rows%nb_procs processes have one more row
+    int local_rows = rows / nb_procs + (rank < rows % nb_procs);
+    int first = rank * (rows / nb_procs) + (rank < rows % nb_procs ? rank : rows % nb_procs);
+    int up = rank > 0 ? rank-1 : MPI_PROC_NULL;
+    int down = rank < nb_procs-1 ? rank+1 : MPI_PROC_NULL;
+    if (rows < nb_procs)
+    {
+        if (rank == 0)
+            printf("The world must have at least one row per process\n");
+        MPI_Finalize();
+        return 1;
+    }
+    #ifdef _OPENACC
+    printf("I am rank %2d and my range is [%5d, %5d[. I use GPU %d over %d devices.\n", rank, first,
+           first+local_rows, info.current_device, info.total_devices);
+    #else
+    printf("I am rank %2d and my range is [%5d, %5d[.\n", rank, first, first+local_rows);
+    #endif
+
+    const size_t size = (size_t) (local_rows+2)*(cols+2);
+    int* world = (int*) malloc(size*sizeof(int));
+    int* oworld = (int*) calloc(size, sizeof(int));
+    // Rows written in the frame: the rows of the process, with the border
+    // of the world for the first and the last processes
+    const int frame_first = rank == 0 ? 0 : first+1;
+    const int frame_rows = local_rows + (rank == 0) + (rank == nb_procs-1);
+    unsigned char* frame = (unsigned char*) malloc((size_t) frame_rows*(cols+2)*sizeof(unsigned char));
+    MPI_Request requests[4];
+    double compute_time = 0., wait_time = 0., output_time = 0.;
+
+    fill_world(world, cols, first, local_rows);
+#pragma acc enter data copyin(world[:size], oworld[:size])
+    int local = alive(world, local_rows, cols);
+    int cells;
+    MPI_Allreduce(&local, &cells, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0)
+        printf("Cells alive at generation %d: %d\n", 0, cells);
+
+    double start = MPI_Wtime();
+    for (int g=1; g <= generations; ++g)
+    {
+        // The current generation becomes the previous one
+        int* tmp = oworld;
+        oworld = world;
+        world = tmp;
+
+        double t0 = MPI_Wtime();
+        exchange(oworld, local_rows, cols, up, down, requests);
+        // The rows [2, local_rows-1] do not need the ghost rows
+        life_rows(oworld, world, 2, local_rows, 1, cols+1, cols+2);
+        double t1 = MPI_Wtime();
+        MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
+        double t2 = MPI_Wtime();
+        life_rows(oworld, world, 1, 2, 1, cols+1, cols+2);
+        if (local_rows > 1)
+            life_rows(oworld, world, local_rows, local_rows+1, 1, cols+1, cols+2);
+        local = alive(world, local_rows, cols);
+        MPI_Allreduce(&local, &cells, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        double t3 = MPI_Wtime();
+        compute_time += (t1-t0) + (t3-t2);
+        wait_time += t2-t1;
+
+        if (frames)
+        {
+            // The ghost rows of the first and last processes are the dead border
+            const size_t offset = (size_t) (rank == 0 ? 0 : 1)*(cols+2);
+#ifdef _OPENACC
+#pragma acc parallel loop copyout(frame[:frame_rows*(cols+2)]) present(world[:size])
+#else
+#pragma omp parallel for
+#endif
+            for (size_t i=0; i < (size_t) frame_rows*(cols+2); ++i)
+                frame[i] = (unsigned char) world[offset+i] * 255;
+            output(frame, (MPI_Offset) frame_first*(cols+2), frame_rows*(cols+2), g);
+            output_time += MPI_Wtime()-t3;
+        }
+        if (rank == 0)
+            printf("Cells alive at generation %4d: %d\n", g, cells);
+    }
+    double end = MPI_Wtime();
+
+    double max_compute, max_wait, max_output;
+    MPI_Reduce(&compute_time, &max_compute, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&wait_time, &max_wait, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&output_time, &max_output, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (rank == 0)
+        printf("The time to compute %d generations on %d processes was %10.5e s "
+               "(max per process: compute %10.5e s, wait for the ghost rows %10.5e s, output %10.5e s)\n",
+               generations, nb_procs, end-start, max_compute, max_wait, max_output);
+
+#pragma acc exit data delete(world[:size], oworld[:size])
+    free(world);
+    free(oworld);
+    free(frame);
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+}
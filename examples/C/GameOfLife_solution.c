@@ -1,25 +1,418 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "mmap_io.h"
+#include "life_random.h"
 
-void output_world(int* restrict world, int rows, int cols, int generation)
+// Size of the blocks advanced several generations at once by next_blocked
+#ifndef BLOCK_ROWS
+#define BLOCK_ROWS 64
+#endif
+#ifndef BLOCK_COLS
+#define BLOCK_COLS 256
+#endif
+// Size of the tiles skipped by next_active when their neighbourhood is stable
+#ifndef TILE_ROWS
+#define TILE_ROWS 16
+#endif
+#ifndef TILE_COLS
+#define TILE_COLS 64
+#endif
+#define MIN(a,b) ( ((a)<(b))?(a):(b) )
+#define MAX(a,b) ( ((a)>(b))?(a):(b) )
+
+// Formats of the files written for each generation
+enum { FRAME_NONE, FRAME_GRAY, FRAME_PBM, FRAME_RLE };
+
+// Number of bytes of a packed row: 8 cells per byte, the first cell in the highest bit
+#define PACKED_COLS(cols) (((size_t) (cols)+7)/8)
+
+void pack_world(int* restrict world, unsigned char* restrict bits, int rows, int cols)
 {
     /**
-     * Write a file with the world inside
+     * Pack the cells of the world without the border, 8 cells per byte
+     * This is the only part of the output done by the generation loop, on
+     * the device with OpenACC: 32 times less data than the world is copied.
      * @param world: a pointer to the storage for the current step
+     * @param bits: a pointer to the rows*PACKED_COLS(cols) bytes of the packed world
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     */
+    const size_t bytes = PACKED_COLS(cols);
+#ifdef _OPENACC
+#pragma acc parallel loop collapse(2) copyout(bits[:rows*bytes]) present(world[:(rows+2)*(cols+2)])
+#else
+#pragma omp parallel for schedule(static)
+#endif
+    for (int r=0; r < rows; ++r)
+        for (size_t b=0; b < bytes; ++b)
+        {
+            unsigned char v = 0;
+            for (int k=0; k < 8; ++k)
+            {
+                size_t c = 8*b+k;
+                if (c < (size_t) cols)
+                    v |= (world[(size_t) (r+1)*(cols+2) + c+1] != 0) << (7-k);
+            }
+            bits[r*bytes+b] = v;
+        }
+}
+
+size_t encode_frame(const unsigned char* restrict bits, unsigned char* restrict out,
+                    int rows, int cols, int format)
+{
+    /**
+     * Encode a packed world in one of the frame formats
+     *   - FRAME_GRAY: one byte per cell with the border, 255 for a living cell
+     *   - FRAME_PBM: "P4" portable bitmap, the packed rows after a text header
+     *   - FRAME_RLE: "LIFE-RLE rows cols" header then, for each row, the
+     *     lengths of the runs of dead and living cells in turn (starting with
+     *     dead cells) as LEB128 numbers
+     * @param bits: a pointer to the packed world
+     * @param out: a pointer to at least (rows+2)*(cols+2)+64 bytes, exactly
+     *             (rows+2)*(cols+2) for FRAME_GRAY
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @param format: the format of the frame
+     * @return the size of the frame in bytes
+     */
+    const size_t bytes = PACKED_COLS(cols);
+    size_t n = 0;
+    if (format == FRAME_GRAY)
+    {
+        n = (size_t) (rows+2)*(cols+2);
+        memset(out, 0, n);
+        for (int r=0; r < rows; ++r)
+            for (int c=0; c < cols; ++c)
+                out[(size_t) (r+1)*(cols+2) + c+1] = bits[r*bytes + c/8] & (0x80 >> (c%8)) ? 255 : 0;
+    }
+    else if (format == FRAME_PBM)
+    {
+        n = sprintf((char*) out, "P4\n%d %d\n", cols, rows);
+        memcpy(out+n, bits, rows*bytes);
+        n += rows*bytes;
+    }
+    else if (format == FRAME_RLE)
+    {
+        n = sprintf((char*) out, "LIFE-RLE %d %d\n", rows, cols);
+        for (int r=0; r < rows; ++r)
+        {
+            size_t run = 0;
+            int state = 0;
+            for (int c=0; c < cols; )
+            {
+                // Cells [c, c+avail[ are in the same byte, the first one in the highest bit
+                const int avail = MIN(8-c%8, cols-c);
+                unsigned int x = ((bits[r*bytes + c/8] ^ (state ? 0xff : 0)) << (c%8)) & 0xff;
+                int same = x ? __builtin_clz(x)-24 : 8;
+                if (same >= avail)
+                {
+                    run += avail;
+                    c += avail;
+                    continue;
+                }
+                run += same;
+                c += same;
+                for (; run >= 0x80; run >>= 7)
+                    out[n++] = (unsigned char) (run | 0x80);
+                out[n++] = (unsigned char) run;
+                run = 0;
+                state = !state;
+            }
+            for (; run >= 0x80; run >>= 7)
+                out[n++] = (unsigned char) (run | 0x80);
+            out[n++] = (unsigned char) run;
+        }
+    }
+    return n;
+}
+
+int decode_frame(const unsigned char* data, size_t size, int* restrict world, int rows, int cols)
+{
+    /**
+     * Set the world from a frame in the FRAME_PBM or FRAME_RLE format
+     * @param data: a pointer to the content of the file
+     * @param size: the size of the file in bytes
+     * @param world: a pointer to the storage for the current step (border already dead)
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @return 0 on success
+     */
+    const size_t bytes = PACKED_COLS(cols);
+    int frame_rows, frame_cols, header = 0;
+    if (sscanf((const char*) data, "P4 %d %d%n", &frame_cols, &frame_rows, &header) == 2)
+    {
+        // A single white space separates the header from the bits
+        ++header;
+        if (frame_rows != rows || frame_cols != cols || size < header + rows*bytes)
+            return 1;
+        for (int r=0; r < rows; ++r)
+            for (int c=0; c < cols; ++c)
+                world[(size_t) (r+1)*(cols+2) + c+1] = (data[header + r*bytes + c/8] >> (7-c%8)) & 1;
+        return 0;
+    }
+    if (sscanf((const char*) data, "LIFE-RLE %d %d%n", &frame_rows, &frame_cols, &header) == 2)
+    {
+        ++header;
+        if (frame_rows != rows || frame_cols != cols)
+            return 1;
+        size_t n = header;
+        for (int r=0; r < rows; ++r)
+        {
+            int c = 0;
+            for (int state=0; c < cols; state = !state)
+            {
+                size_t run = 0;
+                for (int shift=0; ; shift += 7)
+                {
+                    if (n >= size || shift > 56)
+                        return 1;
+                    run |= (size_t) (data[n] & 0x7f) << shift;
+                    if (!(data[n++] & 0x80))
+                        break;
+                }
+                if (run > (size_t) (cols-c))
+                    return 1;
+                for (size_t end=c+run; c < end; ++c)
+                    world[(size_t) (r+1)*(cols+2) + c+1] = state;
+            }
+        }
+        return 0;
+    }
+    return 1;
+}
+
+int load_world(char* path, int* restrict world, int rows, int cols)
+{
+    /**
+     * Set the initial state of the world from a file written for a
+     * generation: .gray (any non zero pixel is a living cell), .pbm or .rle
+     * @param path: the path of the file
+     * @param world: a pointer to the storage for the current step
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @return 0 on success
+     */
+    size_t size = (size_t) (rows+2)*(cols+2);
+    const char* ext = strrchr(path, '.');
+    if (ext != NULL && strcmp(ext, ".gray") != 0)
+    {
+        FILE* file = fopen(path, "rb");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Error: cannot open %s\n", path);
+            return 1;
+        }
+        fseek(file, 0, SEEK_END);
+        long length = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        // The buffer ends with a 0 for the parsing of the header
+        unsigned char* data = (unsigned char*) calloc(length > 0 ? length+1 : 1, sizeof(unsigned char));
+        size_t n = length > 0 ? fread(data, 1, length, file) : 0;
+        fclose(file);
+        memset(world, 0, size*sizeof(int));
+        int status = decode_frame(data, n, world, rows, cols);
+        free(data);
+        if (status != 0)
+            fprintf(stderr, "Error: %s is not a world of %d x %d cells\n", path, rows, cols);
+        return status;
+    }
+    unsigned char* mat = map_input(path, size);
+    if (mat == NULL)
+        return 1;
+    for (int r=0; r < rows+2; ++r)
+        for (int c=0; c < cols+2; ++c)
+            world[r*(cols+2) + c] = mat[r*(cols+2) + c] != 0;
+    unmap(mat, size);
+    // The border of the world is a dead zone
+    for (int r=0; r < rows+2; ++r)
+    {
+        world[r*(cols+2)] = 0;
+        world[r*(cols+2)+cols+1] = 0;
+    }
+    for (int c=0; c < cols+2; ++c)
+    {
+        world[c] = 0;
+        world[(rows+1)*(cols+2)+c] = 0;
+    }
+    return 0;
+}
+
+typedef struct
+{
+    int rows;
+    int cols;
+    int format;
+    // Packed frame k is in the slot k%2: the generation loop packs a frame
+    // while the previous one is encoded and written by the writer thread
+    unsigned char* bits[2];
+    int generation[2];
+    // Encoded frame (pbm and rle), reused for every generation
+    unsigned char* out;
+    // Number of frames packed and written so far
+    size_t packed;
+    size_t written;
+    int closing;
+    int error;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+} frame_writer;
+
+void* frame_writer_thread(void* arg)
+{
+    /**
+     * Encode and write the packed frames in the order of the generations
+     * A gray frame has a known size: it is decoded directly into the mapped
+     * file (mmap_io.h), without a copy through a buffer. The size of the
+     * other formats is known after the encoding only.
+     */
+    frame_writer* w = (frame_writer*) arg;
+    static const char* extension[] = {"", "gray", "pbm", "rle"};
+    for (size_t k=0; ; ++k)
+    {
+        pthread_mutex_lock(&w->lock);
+        while (w->packed <= k && !w->closing)
+            pthread_cond_wait(&w->cond, &w->lock);
+        int more = w->packed > k;
+        pthread_mutex_unlock(&w->lock);
+        if (!more)
+            break;
+
+        char path[80];
+        int error = 0;
+        sprintf(path, "generation%05d.%s", w->generation[k%2], extension[w->format]);
+        if (w->format == FRAME_GRAY)
+        {
+            const size_t size = (size_t) (w->rows+2)*(w->cols+2);
+            unsigned char* frame = map_output(path, size);
+            if (frame == NULL)
+                error = 1;
+            else
+                encode_frame(w->bits[k%2], frame, w->rows, w->cols, FRAME_GRAY);
+            unmap(frame, size);
+        }
+        else
+        {
+            size_t n = encode_frame(w->bits[k%2], w->out, w->rows, w->cols, w->format);
+            FILE* file = fopen(path, "wb");
+            if (file == NULL || fwrite(w->out, 1, n, file) != n)
+                error = 1;
+            if (file != NULL && fclose(file) != 0)
+                error = 1;
+            if (error)
+                fprintf(stderr, "Error: cannot write %s\n", path);
+        }
+
+        pthread_mutex_lock(&w->lock);
+        ++w->written;
+        w->error |= error;
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+    return NULL;
+}
+
+void frame_writer_open(frame_writer* w, int rows, int cols, int format)
+{
+    /**
+     * Allocate the buffers and start the writer thread
+     * @param w: the writer
      * @param rows: the number of rows without the border
      * @param cols: the number of columns without the border
+     * @param format: the format of the files, FRAME_NONE to write nothing
      */
-    char* path = (char*) malloc(sizeof(char)*80);
-    sprintf(path, "generation%05d.gray", generation);
-    FILE* f = fopen(path, "wb");
-    unsigned char* mat = (unsigned char*) malloc(sizeof(unsigned char)*(rows+2)*(cols+2));
-    #pragma acc parallel loop copyout(mat[:(rows+2)*(cols+2)]) present(world[:(rows+2)*(cols+2)])
-    for (int i=0; i<rows+2; ++i)
-        for (int j=0; j<cols+2; ++j)
-            mat[i*cols+j] = (unsigned char) world[i*cols+j] * 255;
-    fwrite(mat, sizeof(unsigned char), (rows+2)*(cols+2), f);
-    fclose(f);
+    memset(w, 0, sizeof(frame_writer));
+    w->rows = rows;
+    w->cols = cols;
+    w->format = format;
+    if (format == FRAME_NONE)
+        return;
+    for (int k=0; k < 2; ++k)
+        w->bits[k] = (unsigned char*) malloc(rows*PACKED_COLS(cols)*sizeof(unsigned char));
+    // Worst case of the run lengths: one byte per cell. The gray frames are
+    // decoded in the mapped files
+    if (format != FRAME_GRAY)
+        w->out = (unsigned char*) malloc(((size_t) (rows+2)*(cols+2)+64)*sizeof(unsigned char));
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    pthread_create(&w->thread, NULL, frame_writer_thread, w);
 }
+
+void frame_writer_push(frame_writer* w, int* restrict world, int generation)
+{
+    /**
+     * Pack a generation and hand it over to the writer thread
+     * Waits only if the writer is still busy with the frame before the previous one.
+     * @param w: the writer
+     * @param world: a pointer to the storage for the current step
+     * @param generation: the generation number used in the name of the file
+     */
+    if (w->format == FRAME_NONE)
+        return;
+    size_t k = w->packed;
+    pthread_mutex_lock(&w->lock);
+    while (w->written+2 <= k)
+        pthread_cond_wait(&w->cond, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+
+    pack_world(world, w->bits[k%2], w->rows, w->cols);
+    w->generation[k%2] = generation;
+
+    pthread_mutex_lock(&w->lock);
+    ++w->packed;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+int frame_format(const char* name)
+{
+    /**
+     * Return the frame format for a name or a file extension (gray, pbm,
+     * rle or none), -1 if the name is unknown
+     */
+    static const char* names[] = {"none", "gray", "pbm", "rle"};
+    for (int f=FRAME_NONE; f <= FRAME_RLE; ++f)
+        if (strcmp(name, names[f]) == 0)
+            return f;
+    return -1;
+}
+
+int frame_writer_close(frame_writer* w)
+{
+    /**
+     * Wait for the frames not written yet, stop the writer thread and free the buffers
+     * @param w: the writer
+     * @return 0 if all the files were written
+     */
+    if (w->format == FRAME_NONE)
+        return 0;
+    pthread_mutex_lock(&w->lock);
+    w->closing = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    free(w->bits[0]);
+    free(w->bits[1]);
+    free(w->out);
+    return w->error;
+}
+
+// Number of living neighbours and rules of the game
+#define STENCIL_NAME life
+#define STENCIL_TYPE int
+#define STENCIL_RADIUS 1
+#define STENCIL_CHANNELS 1
+#define STENCIL_COEFS { {1, 1, 1}, \
+                        {1, 0, 1}, \
+                        {1, 1, 1}}
+#define STENCIL_FINALIZE(neigh, cell) ((neigh) == 3 || ((cell) == 1 && (neigh) == 2))
+#include "stencil.h"
+
 void next(int* restrict world, int* restrict  oworld, int rows, int cols)
 {
     /**
@@ -29,31 +422,126 @@ void next(int* restrict world, int* restrict  oworld, int rows, int cols)
      * @param rows: the number of rows without the border
      * @param cols: the number of columns without the border
      */
-    int neigh = 0;
-    int row_current = 0;
-    int row_above = 0;
-    int row_below = 0;
-#pragma acc parallel loop present(world[:(rows+2)*(cols+2)], oworld[:(rows+2)*(cols+2)])
-    for (int r=1; r<=rows; ++r)
-        for (int c=1; c<=cols; ++c)
+    life(oworld, world, rows+2, cols+2);
+} 
+
+void next_blocked(int* restrict world, int* restrict oworld, int rows, int cols, int steps)
+{
+    /**
+     * Compute several generations at once on the host
+     * Each block of BLOCK_ROWS x BLOCK_COLS cells is copied with a halo of
+     * steps cells into a buffer which stays in the cache, and advanced steps
+     * generations there. The block shrinks by one cell per generation so the
+     * halo is computed redundantly by the neighbouring blocks.
+     * The result is the same as steps calls to next.
+     * @param world: a pointer to the storage for the generation g+steps
+     * @param oworld: a pointer to the storage for the generation g
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @param steps: the number of generations to compute
+     */
+    const size_t size = (size_t) (BLOCK_ROWS+2*steps)*(BLOCK_COLS+2*steps);
+#pragma omp parallel
+{
+    int* a = (int*) malloc(size*sizeof(int));
+    int* b = (int*) malloc(size*sizeof(int));
+#pragma omp for collapse(2) schedule(static)
+    for (int r0=1; r0 <= rows; r0 += BLOCK_ROWS)
+        for (int c0=1; c0 <= cols; c0 += BLOCK_COLS)
         {
-            row_current = r*(cols+2);
-            row_above = (r-1)*(cols+2);
-            row_below = (r+1)*(cols+2);
-            neigh = oworld[row_above + c-1] + oworld[row_above + c]   + oworld[row_above + c+1] +
-                    oworld[row_current + c+1]+                        oworld[row_current + c-1] + 
-                    oworld[row_below + c-1] + oworld[row_below + c] + oworld[row_below + c+1];
-            if (oworld[r*(cols+2)+c] == 1 && (neigh<2||neigh>3))
-                world[r*(cols+2)+c] = 0;
-            else if (neigh==3)
-                world[r*(cols+2)+c] = 1;
+            int r1 = MIN(r0+BLOCK_ROWS, rows+1);
+            int c1 = MIN(c0+BLOCK_COLS, cols+1);
+            // Part of the world (with the border) copied in the buffers
+            int gr0 = MAX(r0-steps, 0);
+            int gr1 = MIN(r1+steps, rows+2);
+            int gc0 = MAX(c0-steps, 0);
+            int gc1 = MIN(c1+steps, cols+2);
+            int width = gc1-gc0;
+            for (int r=gr0; r < gr1; ++r)
+                memcpy(a+(r-gr0)*width, oworld+r*(cols+2)+gc0, width*sizeof(int));
+            // The cells of the border are never computed so they stay dead in both buffers
+            memcpy(b, a, (gr1-gr0)*width*sizeof(int));
+            for (int s=1; s <= steps; ++s)
+            {
+                // Cells still needed by the next generations of the block
+                int e = steps-s;
+                life_block(a, b, MAX(r0-e, 1)-gr0, MIN(r1+e, rows+1)-gr0,
+                           MAX(c0-e, 1)-gc0, MIN(c1+e, cols+1)-gc0, width);
+                int* tmp = a;
+                a = b;
+                b = tmp;
+            }
+            for (int r=r0; r < r1; ++r)
+                memcpy(world+r*(cols+2)+c0, a+(r-gr0)*width+(c0-gc0), (c1-c0)*sizeof(int));
         }
-} 
+    free(a);
+    free(b);
+}
+}
+
+int next_active(int* restrict world, int* restrict oworld, int rows, int cols,
+                const unsigned char* restrict changed, unsigned char* restrict next_changed,
+                int* computed)
+{
+    /**
+     * Compute the next generation on the host, skipping the stable tiles
+     * A tile of TILE_ROWS x TILE_COLS cells is computed only if a cell of
+     * the tile or of its 8 neighbouring tiles changed during the previous
+     * generation. Otherwise the tile did not change during the last two
+     * generations, so world (which holds the generation before oworld)
+     * already holds the right cells.
+     * @param world: a pointer to the storage for the next step
+     * @param oworld: a pointer to the storage for the current step
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @param changed: for each tile, 1 if it changed during the previous generation
+     * @param next_changed: for each tile, set to 1 if it changes during this generation
+     * @param computed: set to the number of tiles computed
+     * @return the variation of the number of cells alive
+     */
+    const int tile_rows = (rows+TILE_ROWS-1)/TILE_ROWS;
+    const int tile_cols = (cols+TILE_COLS-1)/TILE_COLS;
+    int delta = 0;
+    int tiles = 0;
+#pragma omp parallel for collapse(2) reduction(+:delta, tiles) schedule(dynamic)
+    for (int tr=0; tr < tile_rows; ++tr)
+        for (int tc=0; tc < tile_cols; ++tc)
+        {
+            int active = 0;
+            for (int i=MAX(tr-1, 0); i <= MIN(tr+1, tile_rows-1); ++i)
+                for (int j=MAX(tc-1, 0); j <= MIN(tc+1, tile_cols-1); ++j)
+                    active |= changed[i*tile_cols+j];
+            next_changed[tr*tile_cols+tc] = 0;
+            if (!active)
+                continue;
+
+            int r0 = 1+tr*TILE_ROWS;
+            int r1 = MIN(r0+TILE_ROWS, rows+1);
+            int c0 = 1+tc*TILE_COLS;
+            int c1 = MIN(c0+TILE_COLS, cols+1);
+            life_block(oworld, world, r0, r1, c0, c1, cols+2);
+            // Compare the tile with the previous generation while it is in the cache
+            int diff = 0;
+            for (int r=r0; r < r1; ++r)
+#pragma omp simd reduction(+:delta) reduction(|:diff)
+                for (int c=c0; c < c1; ++c)
+                {
+                    int d = world[r*(cols+2)+c] - oworld[r*(cols+2)+c];
+                    delta += d;
+                    diff |= d;
+                }
+            next_changed[tr*tile_cols+tc] = diff != 0;
+            ++tiles;
+        }
+    *computed = tiles;
+    return delta;
+}
 
 void save(int* restrict world, int* restrict oworld, int rows, int cols)
 {
     /**
      * Save the current world to oworld
+     * Not needed by the generation loop which swaps the buffers (see benchmark)
      * @param world: a pointer to the storage for the current step
      * @param oworld: a pointer to the storage for the previous step
      * @param rows: the number of rows without the border
@@ -84,21 +572,47 @@ int alive(int* restrict world, int rows, int cols)
 void fill_world(int* restrict world, int rows, int cols)
 {
     /**
-     *  Set the initial state of the world
+     *  Set the initial state of the world (random, drawn row by row: see life_random.h)
      * @param world: a pointer to the storage for the current step
      * @param rows: the number of rows without the border
      * @param cols: the number of columns without the border
      */
     for (int r=1; r <= rows; ++r)
+    {
+        uint64_t state = row_generator(r-1);
         for (int c=1; c <= cols; ++c)
-            world[r*(cols+2) + c] = rand()%4==0 ?1 : 0;
+            world[r*(cols+2) + c] = random_cell(&state);
+    }
     // The border of the world is a dead zone
-    for (int i=0;i<=rows;++i)
+    for (int i=0;i<=rows+1;++i)
     {
         world[i*(cols+2)] = 0;
         world[i*(cols+2)+cols+1] = 0;
     }
-    for (int j=0; j<cols; ++j)
+    for (int j=0; j<cols+2; ++j)
+    {
+        world[j] = 0;
+        world[(rows+1)*(cols+2)+j] = 0;
+    }
+}
+
+void dead_border(int* restrict world, int rows, int cols)
+{
+    /**
+     * Kill the cells of the border of the world
+     * next never writes the border so it stays dead in both buffers
+     * @param world: a pointer to the storage for a step
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     */
+#pragma acc parallel loop present(world[:(rows+2)*(cols+2)])
+    for (int i=0; i<=rows+1; ++i)
+    {
+        world[i*(cols+2)] = 0;
+        world[i*(cols+2)+cols+1] = 0;
+    }
+#pragma acc parallel loop present(world[:(rows+2)*(cols+2)])
+    for (int j=0; j<cols+2; ++j)
     {
         world[j] = 0;
         world[(rows+1)*(cols+2)+j] = 0;
@@ -132,37 +646,359 @@ void destroy(int* mat, int rows, int cols)
     free(mat);
 }
 
+double elapsed(struct timespec start, struct timespec end)
+{
+    /**
+     * Return the time in seconds between start and end
+     */
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.e9;
+}
+
+void benchmark(int rows, int cols, int generations)
+{
+    /**
+     * Compare the generation loop copying the world (save then next)
+     * with the loop swapping the two buffers
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @param generations: the number of generations to compute
+     */
+    struct timespec end, start;
+    double seconds[2];
+    int cells[2];
+    int* world = allocate(rows, cols);
+    int* oworld = allocate(rows, cols);
+    // Bytes read and written on the inner part of the world by save and next
+    double bytes = 2. * rows * cols * sizeof(int);
+
+    for (int swap=0; swap < 2; ++swap)
+    {
+        fill_world(world, rows, cols);
+#pragma acc update device(world[0:(rows+2)*(cols+2)])
+        dead_border(oworld, rows, cols);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        for (int g=1; g <= generations; ++g)
+        {
+            if (swap)
+            {
+                int* tmp = oworld;
+                oworld = world;
+                world = tmp;
+            }
+            else
+                save(world, oworld, rows, cols);
+            next(world, oworld, rows, cols);
+        }
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        seconds[swap] = elapsed(start, end) / generations;
+        cells[swap] = alive(world, rows, cols);
+    }
+    printf("World of %d x %d cells, %d generations\n", rows, cols, generations);
+    printf("save + next: %10.5e s per generation, %8.1f MB moved\n", seconds[0], 2*bytes/1.e6);
+    printf("swap + next: %10.5e s per generation, %8.1f MB moved\n", seconds[1], bytes/1.e6);
+    printf("Saved per generation: %8.1f MB, %10.5e s (speedup %.2f)\n", bytes/1.e6,
+           seconds[0]-seconds[1], seconds[0]/seconds[1]);
+    printf("Cells alive at the end: %d and %d (%s)\n", cells[0], cells[1],
+           cells[0] == cells[1] ? "identical" : "DIFFERENT");
+
+    destroy(world, rows, cols);
+    destroy(oworld, rows, cols);
+}
+
+void blocked(int steps, int rows, int cols, int generations)
+{
+    /**
+     * Compare the generation loop with the temporal blocking
+     * @param steps: the number of generations computed per pass over the world
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @param generations: the number of generations to compute
+     */
+    struct timespec end, start;
+    size_t size = (size_t) (rows+2)*(cols+2);
+    int* world = allocate(rows, cols);
+    int* oworld = allocate(rows, cols);
+    int* reference = (int*) malloc(size*sizeof(int));
+
+    fill_world(world, rows, cols);
+#pragma acc update device(world[0:(rows+2)*(cols+2)])
+    dead_border(oworld, rows, cols);
+    // Keep a copy of the initial state for the blocked version
+    memcpy(reference, world, size*sizeof(int));
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for (int g=1; g <= generations; ++g)
+    {
+        int* tmp = oworld;
+        oworld = world;
+        world = tmp;
+        next(world, oworld, rows, cols);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("One generation per pass:  %10.5e s\n", elapsed(start, end));
+#pragma acc update self(world[0:(rows+2)*(cols+2)])
+    int* tmp = reference;
+    reference = world;
+    world = tmp;
+
+    // Host version: world holds the initial state
+    dead_border(oworld, rows, cols);
+#pragma acc update self(oworld[0:(rows+2)*(cols+2)])
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for (int g=0; g < generations; g += steps)
+    {
+        tmp = oworld;
+        oworld = world;
+        world = tmp;
+        next_blocked(world, oworld, rows, cols, MIN(steps, generations-g));
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("%3d generations per pass: %10.5e s\n", steps, elapsed(start, end));
+    printf("The worlds after %d generations are %s\n", generations,
+           memcmp(world, reference, size*sizeof(int)) == 0 ? "identical" : "DIFFERENT");
+
+    destroy(world, rows, cols);
+    destroy(oworld, rows, cols);
+    free(reference);
+}
+
+void active(int rows, int cols, int generations, char* path)
+{
+    /**
+     * Run the generation loop skipping the stable tiles and compare
+     * with the usual loop
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @param generations: the number of generations to compute
+     * @param path: the initial state (.gray, .pbm or .rle file, see load_world) or NULL for a random state
+     */
+    struct timespec end, start;
+    size_t size = (size_t) (rows+2)*(cols+2);
+    const int tiles = ((rows+TILE_ROWS-1)/TILE_ROWS) * ((cols+TILE_COLS-1)/TILE_COLS);
+    int* world = allocate(rows, cols);
+    int* oworld = allocate(rows, cols);
+    unsigned char* changed = (unsigned char*) malloc(tiles*sizeof(unsigned char));
+    unsigned char* next_changed = (unsigned char*) malloc(tiles*sizeof(unsigned char));
+    long computed_total = 0;
+
+    if (path != NULL)
+    {
+        if (load_world(path, world, rows, cols) != 0)
+        {
+            destroy(world, rows, cols);
+            destroy(oworld, rows, cols);
+            free(changed);
+            free(next_changed);
+            return;
+        }
+    }
+    else
+        fill_world(world, rows, cols);
+    // The tiles are computed on the host but alive reduces on the device
+#pragma acc update device(world[0:(rows+2)*(cols+2)])
+    // The generation before the initial state is unknown: every tile is computed first
+    memcpy(oworld, world, size*sizeof(int));
+    memset(changed, 1, tiles*sizeof(unsigned char));
+    int cells = alive(world, rows, cols);
+    printf("Cells alive at generation %d: %d\n", 0, cells);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for (int g=1; g <= generations; ++g)
+    {
+        int computed;
+        int* tmp = oworld;
+        oworld = world;
+        world = tmp;
+        cells += next_active(world, oworld, rows, cols, changed, next_changed, &computed);
+        unsigned char* ctmp = changed;
+        changed = next_changed;
+        next_changed = ctmp;
+        computed_total += computed;
+        printf("Cells alive at generation %4d: %d (%5.1f%% of the tiles computed)\n", g, cells,
+               100.*computed/tiles);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("Active tiles only: %10.5e s, %5.1f%% of the tiles computed\n", elapsed(start, end),
+           100.*computed_total/tiles/(generations > 0 ? generations : 1));
+
+    // Reference
+    int* rworld = allocate(rows, cols);
+    int* roworld = allocate(rows, cols);
+    if (path != NULL)
+        load_world(path, rworld, rows, cols);
+    else
+        fill_world(rworld, rows, cols);
+#pragma acc update device(rworld[0:(rows+2)*(cols+2)])
+    dead_border(roworld, rows, cols);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for (int g=1; g <= generations; ++g)
+    {
+        int* tmp = roworld;
+        roworld = rworld;
+        rworld = tmp;
+        next(rworld, roworld, rows, cols);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("All the tiles:     %10.5e s\n", elapsed(start, end));
+#pragma acc update self(rworld[0:(rows+2)*(cols+2)])
+    printf("The worlds after %d generations are %s, %d cells alive\n", generations,
+           memcmp(world, rworld, size*sizeof(int)) == 0 && cells == alive(rworld, rows, cols) ?
+           "identical" : "DIFFERENT", cells);
+
+    destroy(world, rows, cols);
+    destroy(oworld, rows, cols);
+    destroy(rworld, rows, cols);
+    destroy(roworld, rows, cols);
+    free(changed);
+    free(next_changed);
+}
+
+int convert(char* in, char* out, int rows, int cols)
+{
+    /**
+     * Convert a world between the frame formats, given by the extensions
+     * of the files (to look at a .pbm or .rle frame as a .gray picture)
+     * @param in: the path of the original frame
+     * @param out: the path of the converted frame
+     * @param rows: the number of rows without the border
+     * @param cols: the number of columns without the border
+     * @return 0 on success
+     */
+    const char* ext = strrchr(out, '.');
+    int format = ext != NULL ? frame_format(ext+1) : -1;
+    if (format <= FRAME_NONE)
+    {
+        fprintf(stderr, "Error: unknown format for %s\n", out);
+        return 1;
+    }
+    int* world = allocate(rows, cols);
+    unsigned char* bits = (unsigned char*) malloc(rows*PACKED_COLS(cols)*sizeof(unsigned char));
+    unsigned char* data = (unsigned char*) malloc(((size_t) (rows+2)*(cols+2)+64)*sizeof(unsigned char));
+    int status = load_world(in, world, rows, cols);
+    if (status == 0)
+    {
+#pragma acc update device(world[0:(rows+2)*(cols+2)])
+        pack_world(world, bits, rows, cols);
+        size_t n = encode_frame(bits, data, rows, cols, format);
+        FILE* file = fopen(out, "wb");
+        status = file == NULL || fwrite(data, 1, n, file) != n;
+        if (file != NULL && fclose(file) != 0)
+            status = 1;
+        if (status != 0)
+            fprintf(stderr, "Error: cannot write %s\n", out);
+    }
+    destroy(world, rows, cols);
+    free(bits);
+    free(data);
+    return status;
+}
+
 int main(int argc, char** argv)
 {
     int rows, cols, generations;
     int* world;
     int* oworld;
+    int format = FRAME_GRAY;
+    frame_writer writer;
+    struct timespec end, start, t0, t1;
+    double output_time = 0.;
 
     if (argc < 4)
     {
         printf("Wrong number of arguments: Please give rows cols and generations\n");
+        printf("An initial state can be given as a fourth argument (.gray, .pbm or .rle file, - for random)\n");
+        printf("The format of the frames can be given as a fifth argument: gray (default), pbm, rle or none\n");
+        printf("Use \"convert in out rows cols\" to convert a frame to the format of the extension of out\n");
+        printf("Use \"bench rows cols generations\" to measure the cost of copying the world\n");
+        printf("Use \"blocked T rows cols generations\" to compute T generations per pass\n");
+        printf("Use \"active rows cols generations [init.gray]\" to skip the stable parts of the world\n");
         return 1;
     }
+    if (strcmp(argv[1], "convert") == 0)
+    {
+        if (argc < 6)
+        {
+            printf("Wrong number of arguments: Please give convert in out rows and cols\n");
+            return 1;
+        }
+        return convert(argv[2], argv[3], strtol(argv[4], NULL, 10), strtol(argv[5], NULL, 10));
+    }
+    if (strcmp(argv[1], "active") == 0)
+    {
+        if (argc < 5)
+        {
+            printf("Wrong number of arguments: Please give active rows cols and generations\n");
+            return 1;
+        }
+        active(strtol(argv[2], NULL, 10), strtol(argv[3], NULL, 10), strtol(argv[4], NULL, 10),
+               argc >= 6 ? argv[5] : NULL);
+        return 0;
+    }
+    if (strcmp(argv[1], "blocked") == 0)
+    {
+        if (argc < 6)
+        {
+            printf("Wrong number of arguments: Please give blocked T rows cols and generations\n");
+            return 1;
+        }
+        int steps = strtol(argv[2], NULL, 10);
+        blocked(steps > 0 ? steps : 1, strtol(argv[3], NULL, 10), strtol(argv[4], NULL, 10),
+                strtol(argv[5], NULL, 10));
+        return 0;
+    }
+    if (strcmp(argv[1], "bench") == 0)
+    {
+        if (argc < 5)
+        {
+            printf("Wrong number of arguments: Please give bench rows cols and generations\n");
+            return 1;
+        }
+        benchmark(strtol(argv[2], NULL, 10), strtol(argv[3], NULL, 10), strtol(argv[4], NULL, 10));
+        return 0;
+    }
     rows = strtol(argv[1], NULL, 10);
     cols = strtol(argv[2], NULL, 10);
     generations = strtol(argv[3], NULL, 10);
-    
+    if (argc >= 6 && (format = frame_format(argv[5])) < 0)
+    {
+        printf("Unknown format %s: Please give gray, pbm, rle or none\n", argv[5]);
+        return 1;
+    }
+
     world = allocate(rows, cols);
     oworld = allocate(rows, cols);
-    fill_world(world, rows, cols);
+    if (argc >= 5 && strcmp(argv[4], "-") != 0)
+    {
+        if (load_world(argv[4], world, rows, cols) != 0)
+            return 1;
+    }
+    else
+        fill_world(world, rows, cols);
     printf("Initial state set\n");
 #pragma acc update device(world[0:(rows+2)*(cols+2)])
+    dead_border(oworld, rows, cols);
     printf("Cells alive at generation %d: %d\n", 0, alive(world, rows, cols));
+    // The frames are written by a background thread while the next generations are computed
+    frame_writer_open(&writer, rows, cols, format);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
     for (int g=1; g <= generations; ++g)
     {
-        save(world, oworld, rows, cols);
+        // The current generation becomes the previous one
+        int* tmp = oworld;
+        oworld = world;
+        world = tmp;
         next(world, oworld, rows, cols);
-        output_world(world, rows, cols, g);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+        frame_writer_push(&writer, world, g);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+        output_time += elapsed(t0, t1);
         printf("Cells alive at generation %4d: %d\n", g, alive(world, rows, cols));
     }
+    int status = frame_writer_close(&writer);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("The time to compute %d generations was %10.5e s, %10.5e s spent on the output in the loop\n",
+           generations, elapsed(start, end), output_time);
 
     destroy(world, rows, cols);
     destroy(oworld, rows, cols);
 
-    return 0;
+    return status;
 }
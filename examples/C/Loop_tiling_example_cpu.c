@@ -1,7 +1,13 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
 #include <time.h>
+#include "gemm_packed.h"
+#include "autotune.h"
+#include "bench.h"
 
 #define MIN(a,b) ( ((a)<(b))?(a):(b) )
 
@@ -10,6 +16,7 @@ double double_random(){
 }	
 
 void nullify(int ni, int nj, double* d){
+    #pragma omp parallel for
     for (int i=0; i<ni; i++){
        for (int j=0; j<nj; j++){
            d[j+i*nj] = 0.0;
@@ -58,21 +65,35 @@ void tiled_matmul(int tile, int ni, int nj, int nk, double* a, double* b, double
 	     
 }
 
-int main(void)
-{
-    int ni=4280, nj=4024, nk=1960;
- 
-    clock_t t1, t2;
-
-    double* a = (double*) malloc(ni*nk*sizeof(double));
-    double* b = (double*) malloc(nk*nj*sizeof(double));
-    double* c = (double*) malloc(ni*nj*sizeof(double));
-    double* d = (double*) malloc(ni*nj*sizeof(double));
-    double test;
+// Orders of the loops inside a tile of tiled_matmul_order
+#define ORDER_IJK 0  // k innermost, as tiled_matmul
+#define ORDER_IKJ 1  // jj innermost: the rows of b and d are read contiguously
+const char* order_names[] = {"ijk", "ikj"};
 
-    unsigned int seed = 1234;
-    srand(seed);
+void tiled_matmul_order(int tile, int order, int ni, int nj, int nk, double* a, double* b, double* c, double* d){
+    if (order == ORDER_IJK){
+        tiled_matmul(tile, ni, nj, nk, a, b, c, d);
+        return;
+    }
+    for (int i=0; i<ni; i+=tile){
+       for (int j=0; j<nj; j+=tile){
+          for (int ii=i; ii< MIN(i+tile,ni); ii++){
+             for (int k=0; k<nk; k++){
+                for (int jj=j; jj<MIN(j+tile,nj); jj++){
+                    d[ii*nj +jj] = d[ii*nj +jj] + a[k+ii*nk] * b[jj+k*nj];
+                }
+             }
+          }
+       }
+    }
+    for (int i=0; i<ni; i++){
+       for (int j=0; j<nj; j++){
+           d[j+i*nj]= d[j+i*nj] + c[j+i*nj];
+       }
+    }
+}
 
+void fill_matrices(int ni, int nj, int nk, double* a, double* b, double* c){
     for (int i=0; i<ni; i++){
        for (int k=0; k<nk; k++){   
            a[k+i*nk] = double_random();
@@ -90,25 +111,128 @@ int main(void)
            c[j+i*nj] = 2.0;
        }
     }
+}
+
+// Problem timed by the autotuner and the benchmark
+typedef struct {
+    int ni, nj, nk;
+    double *a, *b, *c, *d;
+    int tile, order;
+} matmul_problem;
+
+void setup_matmul(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    nullify(p->ni, p->nj, p->d);
+}
+
+void run_tiled_matmul(const int* config, void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    tiled_matmul_order(config[0], config[1], p->ni, p->nj, p->nk, p->a, p->b, p->c, p->d);
+}
+
+void tune(int ni, int nj, int nk){
+    // Tile sizes and loop orders searched, on a problem of the same shape
+    const int candidates[] = {16, ORDER_IJK, 32, ORDER_IJK, 64, ORDER_IJK, 128, ORDER_IJK, 256, ORDER_IJK,
+                              512, ORDER_IJK, 1024, ORDER_IJK, 16, ORDER_IKJ, 32, ORDER_IKJ, 64, ORDER_IKJ,
+                              128, ORDER_IKJ, 256, ORDER_IKJ, 512, ORDER_IKJ, 1024, ORDER_IKJ};
+    matmul_problem p = {ni, nj, nk, NULL, NULL, NULL, NULL, 0, 0};
+    p.a = (double*) malloc(ni*nk*sizeof(double));
+    p.b = (double*) malloc(nk*nj*sizeof(double));
+    p.c = (double*) malloc(ni*nj*sizeof(double));
+    p.d = (double*) malloc(ni*nj*sizeof(double));
+    fill_matrices(ni, nj, nk, p.a, p.b, p.c);
+    printf("Problem of %d x %d x %d (order 0: %s, 1: %s)\n", ni, nj, nk, order_names[0], order_names[1]);
+    autotune_search("tiled_matmul", "tile order", setup_matmul, run_tiled_matmul, &p, candidates,
+                    sizeof(candidates) / (2*sizeof(int)), 2, 1, 3);
+    free(p.a);
+    free(p.b);
+    free(p.c);
+    free(p.d);
+}
+
+void packed_matmul(int ni, int nj, int nk, double* a, double* b, double* c, double* d){
+    gemm_packed(ni, nj, nk, a, b, d);
+    for (int i=0; i<ni; i++){
+       for (int j=0; j<nj; j++){
+           d[j+i*nj]= d[j+i*nj] + c[j+i*nj];
+       }
+    }
+}
+
+double check_matmul(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    return checksum(p->ni, p->nj, p->d);
+}
+
+void run_naive(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    naive_matmul(p->ni, p->nj, p->nk, p->a, p->b, p->c, p->d);
+}
+
+void run_tiled(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    tiled_matmul_order(p->tile, p->order, p->ni, p->nj, p->nk, p->a, p->b, p->c, p->d);
+}
+
+void run_packed(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    packed_matmul(p->ni, p->nj, p->nk, p->a, p->b, p->c, p->d);
+}
+
+int main(int argc, char** argv)
+{
+    int ni=4280, nj=4024, nk=1960;
+
+    // Arguments: [tune] [ni nj nk] and the options of the benchmark
+    // (csv, json, warmup=N, reps=N). "tune" searches the tile of
+    // tiled_matmul on a problem 4 times smaller in each dimension and
+    // saves it in autotune.cache
+    bench bench;
+    bench_init(&bench, "matmul");
+    int tuning = 0, sizes[3], num_sizes = 0;
+    for (int arg=1; arg<argc; arg++){
+        if (strcmp(argv[arg], "tune") == 0)
+            tuning = 1;
+        else if (!bench_option(&bench, argv[arg]) && num_sizes < 3)
+            sizes[num_sizes++] = atoi(argv[arg]);
+    }
+    if (num_sizes == 3){
+        ni = sizes[0];
+        nj = sizes[1];
+        nk = sizes[2];
+    }
+    unsigned int seed = 1234;
+    srand(seed);
+    if (tuning){
+        tune(ni/4, nj/4, nk/4);
+        return 0;
+    }
+    // Tile and loop order, kept if autotune.cache has no valid entry
+    int config[2] = {512, ORDER_IJK};
+    const int lower[2] = {1, ORDER_IJK}, upper[2] = {INT_MAX, ORDER_IKJ};
+    int tuned = autotune_load("tiled_matmul", config, 2, lower, upper);
 
-    nullify(ni, nj, d);
-    
-    t1 = clock();
-    naive_matmul(ni, nj, nk, a, b, c, d);
-    t2 = clock();
-    test = checksum(ni, nj, d);
-    fprintf(stderr, "CPU naive Elapsed: %lf\n", (double) (t2-t1) /CLOCKS_PER_SEC);
-    fprintf(stderr, "\tchecksum=%lf\n\n", test);
-    nullify(ni, nj, d);
-
-    int tile = 512;
-    t1 = clock();
-    tiled_matmul(tile, ni, nj, nk, a, b, c, d);
-    t2 = clock();
-    test = checksum(ni, nj, d);
-    fprintf(stderr, "CPU Manually tiled Elapsed: %lf\n", (double) (t2-t1) /CLOCKS_PER_SEC);
-    fprintf(stderr, "\tchecsum=%lf\n\n", test);
-    nullify(ni, nj, d);
+    double* a = (double*) malloc(ni*nk*sizeof(double));
+    double* b = (double*) malloc(nk*nj*sizeof(double));
+    double* c = (double*) malloc(ni*nj*sizeof(double));
+    double* d = (double*) malloc(ni*nj*sizeof(double));
+
+    fill_matrices(ni, nj, nk, a, b, c);
+
+    // One run: 2 ni nj nk operations for the product and ni nj for c. The
+    // bytes are the minimum traffic: a, b and c read once, d read and written
+    matmul_problem problem = {ni, nj, nk, a, b, c, d, config[0], config[1]};
+    const double flops = 2.0*ni*nj*nk + (double) ni*nj;
+    const double bytes = sizeof(double) * ((double) ni*nk + (double) nk*nj + 3.0*ni*nj);
+    char name[64], tiled_name[64];
+    snprintf(name, sizeof(name), "matmul %d x %d x %d", ni, nj, nk);
+    snprintf(tiled_name, sizeof(tiled_name), "CPU tiled %d %s (%s)", config[0], order_names[config[1]],
+             tuned ? "tuned" : "default");
+    bench.name = name;
+    bench_add(&bench, "CPU naive", setup_matmul, run_naive, check_matmul, &problem, flops, bytes);
+    bench_add(&bench, tiled_name, setup_matmul, run_tiled, check_matmul, &problem, flops, bytes);
+    bench_add(&bench, "CPU packed panels", setup_matmul, run_packed, check_matmul, &problem, flops, bytes);
+    bench_run(&bench);
 
     free(a);
     free(b);
@@ -116,4 +240,4 @@ int main(void)
     free(d);
 
     return 0;
-}	
+}
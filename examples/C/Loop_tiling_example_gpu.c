@@ -1,7 +1,13 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <math.h>
 #include <time.h>
+#include <string.h>
+#include <limits.h>
+#include "gemm_packed.h"
+#include "autotune.h"
+#include "bench.h"
 
 #define MIN(a,b) ( ((a)<(b))?(a):(b) )
 
@@ -80,17 +86,92 @@ void tiled_matmul(int tile, int ni, int nj, int nk, double* a, double* b, double
 	     
 }
 
-int main(void)
+void packed_matmul(int ni, int nj, int nk, double* a, double* b, double* c, double* d){
+    gemm_packed(ni, nj, nk, a, b, d);
+    for (int i=0; i<ni; i++){
+       for (int j=0; j<nj; j++){
+           d[j+i*nj]= d[j+i*nj] + c[j+i*nj];
+       }
+    }
+}
+
+// Problem timed by the benchmark
+typedef struct {
+    int ni, nj, nk;
+    double *a, *b, *c, *d;
+    int tile;
+} matmul_problem;
+
+void setup_device(void* data){
+    // d is set to 0 on the GPU: no transfer between the runs
+    matmul_problem* p = (matmul_problem*) data;
+    double* d = p->d;
+    int n = p->ni*p->nj;
+    #pragma acc parallel loop default(present)
+    for (int i=0; i<n; i++){
+        d[i] = 0.0;
+    }
+}
+
+double check_device(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    double* d = p->d;
+    #pragma acc update self(d[0:p->ni*p->nj])
+    return checksum(p->ni, p->nj, d);
+}
+
+void setup_host(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    nullify(p->ni, p->nj, p->d);
+}
+
+double check_host(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    return checksum(p->ni, p->nj, p->d);
+}
+
+void run_naive(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    naive_matmul(p->ni, p->nj, p->nk, p->a, p->b, p->c, p->d);
+}
+
+void run_acc_tiled(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    naive_matmul_acc_tiled(p->ni, p->nj, p->nk, p->a, p->b, p->c, p->d);
+}
+
+void run_tiled(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    tiled_matmul(p->tile, p->ni, p->nj, p->nk, p->a, p->b, p->c, p->d);
+}
+
+void run_packed(void* data){
+    matmul_problem* p = (matmul_problem*) data;
+    packed_matmul(p->ni, p->nj, p->nk, p->a, p->b, p->c, p->d);
+}
+
+int main(int argc, char** argv)
 {
     int ni=4280, nj=4024, nk=1960;
- 
-    clock_t t1, t2;
+
+    // Arguments: [ni nj nk] and the options of the benchmark (csv, json, warmup=N, reps=N)
+    bench bench;
+    bench_init(&bench, "matmul");
+    int sizes[3], num_sizes = 0;
+    for (int arg=1; arg<argc; arg++){
+        if (!bench_option(&bench, argv[arg]) && num_sizes < 3)
+            sizes[num_sizes++] = atoi(argv[arg]);
+    }
+    if (num_sizes == 3){
+        ni = sizes[0];
+        nj = sizes[1];
+        nk = sizes[2];
+    }
 
     double* a = (double*) malloc(ni*nk*sizeof(double));
     double* b = (double*) malloc(nk*nj*sizeof(double));
     double* c = (double*) malloc(ni*nj*sizeof(double));
     double* d = (double*) malloc(ni*nj*sizeof(double));
-    double test;
 
     unsigned int seed = 1234;
     srand(seed);
@@ -114,39 +195,32 @@ int main(void)
     }
 
     nullify(ni, nj, d);
+
+    // Tile of tiled_matmul: the entry saved by "Loop_tiling_example_cpu tune"
+    // for this host, 512 otherwise. The loop order of the entry is not used:
+    // the threads of the GPU kernel run the ii and jj loops.
+    int config[2] = {512, 0};
+    const int lower[2] = {1, 0}, upper[2] = {INT_MAX, 1};
+    int tuned = autotune_load("tiled_matmul", config, 2, lower, upper);
+
+    // One run: 2 ni nj nk operations for the product and ni nj for c. The
+    // bytes are the minimum traffic: a, b and c read once, d read and written
+    matmul_problem problem = {ni, nj, nk, a, b, c, d, config[0]};
+    const double flops = 2.0*ni*nj*nk + (double) ni*nj;
+    const double bytes = sizeof(double) * ((double) ni*nk + (double) nk*nj + 3.0*ni*nj);
+    char name[64], tiled_name[64];
+    snprintf(name, sizeof(name), "matmul %d x %d x %d", ni, nj, nk);
+    snprintf(tiled_name, sizeof(tiled_name), "GPU Manually tiled %d (%s)", config[0], tuned ? "tuned" : "default");
+    bench.name = name;
+    bench_add(&bench, "GPU naive", setup_device, run_naive, check_device, &problem, flops, bytes);
+    bench_add(&bench, "GPU OpenACC tiled", setup_device, run_acc_tiled, check_device, &problem, flops, bytes);
+    bench_add(&bench, tiled_name, setup_device, run_tiled, check_device, &problem, flops, bytes);
+    // Packed panels on the host, with the host copies of the matrices
+    bench_add(&bench, "CPU packed panels", setup_host, run_packed, check_host, &problem, flops, bytes);
     
     #pragma acc data copyin(a[0:ni*nk], b[0:nk*nj], c[0:ni*nj]) create(d[0:ni*nj])    
     {
-    t1 = clock();
-    naive_matmul(ni, nj, nk, a, b, c, d);
-    t2 = clock();
-    #pragma acc update self(d[0:ni*nj])
-    test = checksum(ni, nj, d);
-    fprintf(stderr, "GPU naive Elapsed: %lf\n", (double) (t2-t1) /CLOCKS_PER_SEC);
-    fprintf(stderr, "\tchecksum=%lf\n\n", test);
-    nullify(ni, nj, d);
-    #pragma acc update device(d[0:ni*nj])
-
-    t1 = clock();
-    naive_matmul_acc_tiled(ni, nj, nk, a, b, c, d);
-    t2 = clock();
-    #pragma acc update self(d[0:ni*nj])
-    test = checksum(ni, nj, d);
-    fprintf(stderr, "GPU OpenACC tiled Elapsed: %lf\n", (double) (t2-t1) /CLOCKS_PER_SEC);
-    fprintf(stderr, "\tchecksum=%lf\n\n", test);
-    nullify(ni, nj, d);
-    #pragma acc update device(d[0:ni*nj])    
-
-    int tile = 512;
-    t1 = clock();
-    tiled_matmul(tile, ni, nj, nk, a, b, c, d);
-    t2 = clock();
-    #pragma acc update self(d[0:ni*nj])
-    test = checksum(ni, nj, d);
-    fprintf(stderr, "GPU Manually tiled Elapsed: %lf\n", (double) (t2-t1) /CLOCKS_PER_SEC);
-    fprintf(stderr, "\tchecksum=%lf\n\n", test);
-
-
+    bench_run(&bench);
     }
 
     free(a);
@@ -1,33 +1,372 @@
 #include <stdio.h>
-int main(void)
-{ 
-    int ny = 10000;
-    int nx = 10000;
-    int idxA, idxB;
-    int a[nx*ny], b[nx*ny];
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "autotune.h"
+#include "bench.h"
+/**
+ * Transpose of a matrix by tiles
+ *
+ * a has ny rows of nx elements and b = transpose(a) has nx rows of ny
+ * elements. On the GPU the loops are tiled by the tile(32,32) clause of
+ * OpenACC, whose sizes must be constants. On the host the tiles are explicit:
+ * their sizes and the order of the loops inside a tile are read from
+ * autotune.cache, 32 x 32 otherwise. "./Tiles_optimization_example tune"
+ * searches them on the current host.
+ *
+ * The recursive transpose needs no tile size: it splits the longest
+ * dimension in two until the block fits in any cache (cache-oblivious). The
+ * square matrices are also transposed in place, by swapping the blocks on
+ * each side of the diagonal.
+ *
+ * The variants are timed by the benchmark harness (bench.h) on a square and
+ * two rectangular shapes and checked by their number of errors.
+ *
+ * Usage: ./Tiles_optimization_example [tune] [csv|json] [warmup=N] [reps=N]
+ */
 
-// Structured data region
-    #pragma acc data copyout(a, b)
-    {
-        #pragma acc parallel loop present(a, b)
-        for(int i=0; i<nx*ny; ++i)
-            a[i] = i;
-           
-        #pragma acc parallel loop present(a, b) tile(32,32)
-        for (int i=0; i<nx; ++i){
-            for (int j=0; j<ny; ++j){
-                idxB = j + (i)*nx;
-                idxA = i + (j)*ny;
-                b[idxB] = a[idxA];
+#define MIN(a,b) ( ((a)<(b))?(a):(b) )
+// Number of elements below which the recursion stops (the block is copied
+// with two loops) and above which the halves are OpenMP tasks
+#ifndef LEAF_SIZE
+#define LEAF_SIZE 4096
+#endif
+#ifndef TASK_SIZE
+#define TASK_SIZE 65536
+#endif
+
+void transpose_tiled(const int* restrict a, int* restrict b, int nx, int ny, int tile_i, int tile_j, int order)
+{
+    /**
+     * Transpose a on the host: b[j + i*ny] = a[i + j*nx]
+     * @param tile_i, tile_j: the size of the tiles in i and j
+     * @param order: 0 for j innermost in a tile (b written contiguously), 1 for i innermost
+     */
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int i0=0; i0<nx; i0+=tile_i)
+        for (int j0=0; j0<ny; j0+=tile_j)
+        {
+            if (order == 0)
+                for (int i=i0; i<MIN(i0+tile_i, nx); ++i)
+                    for (int j=j0; j<MIN(j0+tile_j, ny); ++j)
+                        b[j + (size_t) i*ny] = a[i + (size_t) j*nx];
+            else
+                for (int j=j0; j<MIN(j0+tile_j, ny); ++j)
+                    for (int i=i0; i<MIN(i0+tile_i, nx); ++i)
+                        b[j + (size_t) i*ny] = a[i + (size_t) j*nx];
+        }
+}
+
+void transpose_naive(const int* restrict a, int* restrict b, int nx, int ny)
+{
+    /**
+     * Transpose a on the host without tiles: b[j + i*ny] = a[i + j*nx]
+     */
+#pragma omp parallel for schedule(static)
+    for (int i=0; i<nx; ++i)
+        for (int j=0; j<ny; ++j)
+            b[j + (size_t) i*ny] = a[i + (size_t) j*nx];
+}
+
+void transpose_block(const int* restrict a, int* restrict b, int nx, int ny, int i0, int i1, int j0, int j1)
+{
+    /**
+     * Transpose the block [i0, i1[ x [j0, j1[ of a into b by recursive halving
+     * @param nx, ny: the size of a
+     */
+    const int di = i1-i0, dj = j1-j0;
+    if ((size_t) di*dj <= LEAF_SIZE)
+    {
+        for (int i=i0; i<i1; ++i)
+            for (int j=j0; j<j1; ++j)
+                b[j + (size_t) i*ny] = a[i + (size_t) j*nx];
+        return;
+    }
+    if (di >= dj)
+    {
+        const int im = i0 + di/2;
+#pragma omp task if((size_t) di*dj > TASK_SIZE)
+        transpose_block(a, b, nx, ny, i0, im, j0, j1);
+        transpose_block(a, b, nx, ny, im, i1, j0, j1);
+    }
+    else
+    {
+        const int jm = j0 + dj/2;
+#pragma omp task if((size_t) di*dj > TASK_SIZE)
+        transpose_block(a, b, nx, ny, i0, i1, j0, jm);
+        transpose_block(a, b, nx, ny, i0, i1, jm, j1);
+    }
+#pragma omp taskwait
+}
+
+void transpose_recursive(const int* restrict a, int* restrict b, int nx, int ny)
+{
+    /**
+     * Transpose a on the host, cache-oblivious: b[j + i*ny] = a[i + j*nx]
+     */
+#pragma omp parallel
+#pragma omp single
+    transpose_block(a, b, nx, ny, 0, nx, 0, ny);
+}
+
+void swap_blocks(int* a, int n, int i0, int i1, int j0, int j1)
+{
+    /**
+     * Swap the block [i0, i1[ x [j0, j1[ of the square matrix a with its
+     * transpose [j0, j1[ x [i0, i1[ (the blocks must not overlap)
+     * @param n: the size of a
+     */
+    const int di = i1-i0, dj = j1-j0;
+    if ((size_t) di*dj <= LEAF_SIZE)
+    {
+        for (int i=i0; i<i1; ++i)
+            for (int j=j0; j<j1; ++j)
+            {
+                const int t = a[j + (size_t) i*n];
+                a[j + (size_t) i*n] = a[i + (size_t) j*n];
+                a[i + (size_t) j*n] = t;
             }
+        return;
+    }
+    if (di >= dj)
+    {
+        const int im = i0 + di/2;
+#pragma omp task if((size_t) di*dj > TASK_SIZE)
+        swap_blocks(a, n, i0, im, j0, j1);
+        swap_blocks(a, n, im, i1, j0, j1);
+    }
+    else
+    {
+        const int jm = j0 + dj/2;
+#pragma omp task if((size_t) di*dj > TASK_SIZE)
+        swap_blocks(a, n, i0, i1, j0, jm);
+        swap_blocks(a, n, i0, i1, jm, j1);
+    }
+#pragma omp taskwait
+}
+
+void transpose_diagonal(int* a, int n, int i0, int i1)
+{
+    /**
+     * Transpose in place the diagonal block [i0, i1[ x [i0, i1[ of the square matrix a
+     * The two diagonal halves are transposed and the two other blocks swapped.
+     */
+    const int d = i1-i0;
+    if ((size_t) d*d <= LEAF_SIZE)
+    {
+        for (int i=i0; i<i1; ++i)
+            for (int j=i+1; j<i1; ++j)
+            {
+                const int t = a[j + (size_t) i*n];
+                a[j + (size_t) i*n] = a[i + (size_t) j*n];
+                a[i + (size_t) j*n] = t;
+            }
+        return;
+    }
+    const int im = i0 + d/2;
+#pragma omp task if((size_t) d*d > TASK_SIZE)
+    transpose_diagonal(a, n, i0, im);
+#pragma omp task if((size_t) d*d > TASK_SIZE)
+    transpose_diagonal(a, n, im, i1);
+    swap_blocks(a, n, im, i1, i0, im);
+#pragma omp taskwait
+}
+
+void transpose_in_place(int* a, int n)
+{
+    /**
+     * Transpose the square matrix a in place, cache-oblivious
+     */
+#pragma omp parallel
+#pragma omp single
+    transpose_diagonal(a, n, 0, n);
+}
+
+void transpose_acc(const int* restrict a, int* restrict b, int nx, int ny)
+{
+    #pragma acc parallel loop present(a, b) tile(32,32)
+    for (int i=0; i<nx; ++i){
+        for (int j=0; j<ny; ++j){
+            int idxB = j + (i)*ny;
+            int idxA = i + (j)*nx;
+            b[idxB] = a[idxA];
         }
     }
+}
+
+long count_errors(const int* a, const int* b, int nx, int ny)
+{
+    long errors = 0;
+    for (int i=0; i<nx; ++i)
+        for (int j=0; j<ny; ++j)
+            errors += b[j + (size_t) i*ny] != a[i + (size_t) j*nx];
+    return errors;
+}
+
+// Problem timed by the autotuner and the benchmark
+typedef struct
+{
+    int nx, ny;
+    int* a;
+    int* b;
+    int tile_i, tile_j, order;
+} transpose_problem;
+
+void run_transpose(const int* config, void* data)
+{
+    transpose_problem* p = (transpose_problem*) data;
+    transpose_tiled(p->a, p->b, p->nx, p->ny, config[0], config[1], config[2]);
+}
+
+void tune(int* a, int* b, int nx, int ny)
+{
+    /**
+     * Search the size of the tiles and the order of the loops and save the best ones
+     */
+    const int sizes[] = {16, 32, 64, 128, 256};
+    const int num_sizes = sizeof(sizes) / sizeof(int);
+    int candidates[3*2*num_sizes*num_sizes];
+    int count = 0;
+    for (int order=0; order<2; ++order)
+        for (int ti=0; ti<num_sizes; ++ti)
+            for (int tj=0; tj<num_sizes; ++tj)
+            {
+                candidates[3*count] = sizes[ti];
+                candidates[3*count+1] = sizes[tj];
+                candidates[3*count+2] = order;
+                ++count;
+            }
+    transpose_problem p = {nx, ny, a, b, 0, 0, 0};
+    autotune_search("transpose_tiled", "tile_i tile_j order", NULL, run_transpose, &p, candidates, count, 3,
+                    1, 3);
+}
+
+void run_naive(void* data)
+{
+    transpose_problem* p = (transpose_problem*) data;
+    transpose_naive(p->a, p->b, p->nx, p->ny);
+}
+
+void run_tiled(void* data)
+{
+    transpose_problem* p = (transpose_problem*) data;
+    transpose_tiled(p->a, p->b, p->nx, p->ny, p->tile_i, p->tile_j, p->order);
+}
+
+void run_recursive(void* data)
+{
+    transpose_problem* p = (transpose_problem*) data;
+    transpose_recursive(p->a, p->b, p->nx, p->ny);
+}
+
+void setup_in_place(void* data)
+{
+    // b starts as a copy of a
+    transpose_problem* p = (transpose_problem*) data;
+    memcpy(p->b, p->a, (size_t) p->nx*p->ny*sizeof(int));
+}
+
+void run_in_place(void* data)
+{
+    transpose_problem* p = (transpose_problem*) data;
+    transpose_in_place(p->b, p->nx);
+}
+
+void run_acc(void* data)
+{
+    transpose_problem* p = (transpose_problem*) data;
+    transpose_acc(p->a, p->b, p->nx, p->ny);
+}
+
+double check_host(void* data)
+{
+    transpose_problem* p = (transpose_problem*) data;
+    return count_errors(p->a, p->b, p->nx, p->ny);
+}
+
+double check_device(void* data)
+{
+    transpose_problem* p = (transpose_problem*) data;
+    int* b = p->b;
+    #pragma acc update self(b[0:p->nx*p->ny])
+    return count_errors(p->a, b, p->nx, p->ny);
+}
+
+int main(int argc, char** argv)
+{
+    // Shapes (nx, ny) with the same number of elements
+    const int shapes[][2] = {{10000, 10000}, {20000, 5000}, {5000, 20000}};
+    const int num_shapes = sizeof(shapes) / sizeof(shapes[0]);
+    const size_t size = 100000000;
+    // On the heap: 2 x 400 MB do not fit in the stack
+    int* a = (int*) malloc(size*sizeof(int));
+    int* b = (int*) malloc(size*sizeof(int));
+    bench options;
+    bench_init(&options, "");
+    int tuning = 0;
+    for (int arg=1; arg<argc; ++arg)
+    {
+        if (strcmp(argv[arg], "tune") == 0)
+            tuning = 1;
+        else if (!bench_option(&options, argv[arg]))
+            fprintf(stderr, "Unknown argument %s\n", argv[arg]);
+    }
+
+    for (size_t i=0; i<size; ++i)
+        a[i] = i;
+    if (tuning)
+    {
+        tune(a, b, shapes[0][0], shapes[0][1]);
+        free(a);
+        free(b);
+        return 0;
+    }
+    // Tiles and loop order, kept if autotune.cache has no valid entry
+    int config[3] = {32, 32, 0};
+    const int lower[3] = {1, 1, 0}, upper[3] = {INT_MAX, INT_MAX, 1};
+    int tuned = autotune_load("transpose_tiled", config, 3, lower, upper);
+    char best_name[64];
+    snprintf(best_name, sizeof(best_name), "tiled %d x %d order %d (%s)", config[0], config[1], config[2],
+             tuned ? "tuned" : "default");
+
+    for (int s=0; s<num_shapes; ++s)
+    {
+        const int nx = shapes[s][0];
+        const int ny = shapes[s][1];
+        char name[64];
+        snprintf(name, sizeof(name), "transpose %d x %d", nx, ny);
+        bench bench = options;
+        bench.name = name;
+
+        // One run reads a and writes b: no floating point operation
+        const double bytes = 2. * sizeof(int) * nx * ny;
+        transpose_problem fixed = {nx, ny, a, b, 32, 32, 0};
+        transpose_problem best = {nx, ny, a, b, config[0], config[1], config[2]};
+        bench_add(&bench, "naive", NULL, run_naive, check_host, &fixed, 0., bytes);
+        bench_add(&bench, "tiled 32 x 32", NULL, run_tiled, check_host, &fixed, 0., bytes);
+        bench_add(&bench, best_name, NULL, run_tiled, check_host, &best, 0., bytes);
+        bench_add(&bench, "recursive", NULL, run_recursive, check_host, &fixed, 0., bytes);
+        if (nx == ny)
+            bench_add(&bench, "recursive in place", setup_in_place, run_in_place, check_host, &fixed, 0., bytes);
+#ifdef _OPENACC
+        bench_add(&bench, "OpenACC tile(32,32)", NULL, run_acc, check_device, &fixed, 0., bytes);
+#endif
+
+// Structured data region
+        #pragma acc data copyin(a[0:nx*ny]) create(b[0:nx*ny])
+        {
+            bench_run(&bench);
+        }
 // End of structured data region
+    }
+
 /*
     fprintf(stderr,"A: \n");
     for(int i=0; i<nx*ny; ++i) fprintf(stderr,"%d\n",a[i]);
     fprintf(stderr,"\n");
     fprintf(stderr,"B: \n");
     for(int i=0; i<nx*ny; ++i) fprintf(stderr,"%d\n",b[i]);
-*/    
+*/
+    free(a);
+    free(b);
 }
@@ -1,51 +1,178 @@
 #include <stdio.h>
 #include <stdlib.h>
-double* create_mat(int dim, int stream)
+#include <math.h>
+#include "matrix_formats.h"
+#include "bench.h"
+/**
+ * Product of two structured matrices initialised asynchronously
+ *
+ * The three matrices are initialised on three different queues, which
+ * overlap, and the product waits for the three of them. The matrices are
+ * stored in the format chosen by create_mat for their structure (see
+ * matrix_formats.h), so a diagonal or banded product does not go through the
+ * O(dim^3) dense product. The benchmark harness (bench.h) times both for a
+ * diagonal, a tridiagonal and a 5-point stencil matrix:
+ *   - dense: the three matrices stored as dense, product by blocks of C
+ *     without atomic operation
+ *   - atomic (original): the same dense matrices, one thread per product
+ *     a_ik b_kj added to c_ij by an atomic operation
+ *   - the format chosen for A, B and C, and the kernel of these formats
+ * The check is the sum of the elements of C weighted by their position
+ * (mat_checksum): the rows of the tridiagonal and 5-point products sum to 0.
+ *
+ * Usage: ./async_async_solution [dim] [csv|json] [warmup=N] [reps=N]
+ */
+
+// Operands and product in one format
+typedef struct
+{
+    matrix* A;
+    matrix* B;
+    matrix* C;
+} product;
+
+void create_operands(product* p, int dim, int ndiags, const int* offsets, const double* diags_a,
+                     const double* diags_b, int dense)
 {
-    double* mat = (double*) malloc(dim*dim*sizeof(double));
-    #pragma acc enter data create(mat[0:dim*dim]) async(stream)
-    return mat;
+    /**
+     * Create A, B and C on the queues 1, 2 and 3 and initialise them
+     * @param ndiags, offsets: the structure of A and B
+     * @param diags_a, diags_b: the values of the diagonals of A and B
+     * @param dense: store the three matrices as dense instead of choosing the format
+     */
+    if (dense)
+    {
+        p->A = create_mat_format(dim, ndiags, offsets, MAT_DENSE, 1);
+        p->B = create_mat_format(dim, ndiags, offsets, MAT_DENSE, 2);
+        p->C = create_mat_format(dim, 0, NULL, MAT_DENSE, 3);
+    }
+    else
+    {
+        p->A = create_mat(dim, ndiags, offsets, 1);
+        p->B = create_mat(dim, ndiags, offsets, 2);
+        p->C = create_product(p->A, p->B, 3);
+    }
+    double* zeros = (double*) calloc(p->C->ndiags + 1, sizeof(double));
+    init_mat(p->A, diags_a, 1);
+    init_mat(p->B, diags_b, 2);
+    init_mat(p->C, zeros, 3);
+    free(zeros);
 }
 
-void init_mat(double* mat, int dim, double diag, int stream)
+void free_operands(product* p)
 {
-    #pragma acc parallel loop present(mat[0:dim*dim]) async(stream)
-    for (int i=0; i<dim; ++i)
-        #pragma acc loop
-        for (int j=0; j<dim; ++j)
-        {
-            mat[i*dim+j] = 0.;
-        }
-    #pragma acc parallel loop present(mat[0:dim*dim]) async(stream)
-    for (int i=0; i<dim; ++i)
-        mat[i*dim+i] = diag;
+    free_mat(p->A);
+    free_mat(p->B);
+    free_mat(p->C);
+}
+
+void run_product(void* data)
+{
+    product* p = (product*) data;
+    mat_multiply(p->A, p->B, p->C);
+}
+
+void setup_atomic(void* data)
+{
+    /**
+     * Set the dense C to 0 before the atomic product, which adds to it
+     */
+    product* p = (product*) data;
+    init_mat(p->C, NULL, p->C->queue);
+}
+
+void run_atomic(void* data)
+{
+    /**
+     * C += A*B for dense matrices: each thread adds one product a_ik b_kj to
+     * c_ij, the threads of the same (i, j) are serialised by the atomic update
+     */
+    product* p = (product*) data;
+    const int dim = p->A->dim;
+    const double* A = p->A->values;
+    const double* B = p->B->values;
+    double* C = p->C->values;
+#pragma acc parallel present(A[:dim*dim], B[:dim*dim], C[:dim*dim]) wait(p->A->queue, p->B->queue, p->C->queue)
+    {
+#pragma acc loop gang vector collapse(3)
+        for (int i=0; i<dim; ++i)
+            for (int k=0; k<dim; ++k)
+                for (int j=0; j<dim; ++j)
+                {
+#pragma acc atomic update
+                    C[(size_t) i*dim+j] += A[(size_t) i*dim+k] * B[(size_t) k*dim+j];
+                }
+    }
 }
 
-int main(void)
+double check_product(void* data)
+{
+    product* p = (product*) data;
+    return mat_checksum(p->C);
+}
+
+int main(int argc, char** argv)
 {
     int dim = 5000;
-    
-    double* restrict A = create_mat(dim, 1);
-    double* restrict B = create_mat(dim, 2);
-    double* restrict C = create_mat(dim, 3);
-    
-    init_mat(A, dim, 6.0, 1);
-    init_mat(B, dim, 7.0, 2);
-    init_mat(C, dim, 0.0, 3);
-
-    #pragma acc parallel present(A[:dim*dim], B[:dim*dim], C[:dim*dim]) wait(1,2,3)
+
+    // A dense product takes seconds: no warm-up and a single timed run by default
+    bench options;
+    bench_init(&options, "");
+    options.warmup = 0;
+    options.repetitions = 1;
+    for (int arg=1; arg<argc; ++arg)
+        if (!bench_option(&options, argv[arg]))
+            dim = atoi(argv[arg]);
+
+    // The stencil is on a grid of nx columns
+    const int nx = (int) sqrt(dim);
+    const struct
     {
-    #pragma acc loop gang vector collapse(3)
-    for (int i=0; i<dim; ++i)
-        for (int k=0; k<dim; ++k)
-            for (int j=0; j<dim; ++j)
-            {
-                #pragma acc atomic update
-                C[i*dim+j] += A[i*dim+k] * B[k*dim+j];
-            }
+        const char* name;
+        int ndiags;
+        int offsets[5];
+        double a[5];
+        double b[5];
+    } structures[] = {
+        {"diagonal", 1, {0}, {6.0}, {7.0}},
+        {"tridiagonal", 3, {-1, 0, 1}, {-1.0, 2.0, -1.0}, {-1.0, 2.0, -1.0}},
+        {"5-point stencil", 5, {-nx, -1, 0, 1, nx}, {-1.0, -1.0, 4.0, -1.0, -1.0}, {-1.0, -1.0, 4.0, -1.0, -1.0}},
+    };
+    const int num_structures = sizeof(structures) / sizeof(structures[0]);
+
+    for (int s=0; s < num_structures; ++s)
+    {
+        product dense, structured;
+        create_operands(&dense, dim, structures[s].ndiags, structures[s].offsets, structures[s].a,
+                        structures[s].b, 1);
+        create_operands(&structured, dim, structures[s].ndiags, structures[s].offsets, structures[s].a,
+                        structures[s].b, 0);
+
+        char name[64], variant[64];
+        snprintf(name, sizeof(name), "%s %d x %d", structures[s].name, dim, dim);
+        snprintf(variant, sizeof(variant), "%s x %s -> %s", mat_format_names[structured.A->format],
+                 mat_format_names[structured.B->format], mat_format_names[structured.C->format]);
+        bench bench = options;
+        bench.name = name;
+        bench_add(&bench, "dense", NULL, run_product, check_product, &dense, 2. * dim * dim * dim, 0.);
+        bench_add(&bench, "atomic (original)", setup_atomic, run_atomic, check_product, &dense,
+                  2. * dim * dim * dim, 0.);
+        bench_add(&bench, variant, NULL, run_product, check_product, &structured, 0., 0.);
+        bench_run(&bench);
+        if (bench.format == BENCH_TEXT)
+        {
+            const double dense_time = bench.variants[0].stats.median;
+            printf("Speedup of dense over atomic: %.1f\n", bench.variants[1].stats.median / dense_time);
+            printf("Speedup of %s: %.1f\n", variant, dense_time / bench.variants[2].stats.median);
+        }
+
+        if (s == 0)
+        {
+            mat_update_self(structured.C);
+            printf("Check that value is equal to 42.: %f\n", mat_get(structured.C, 0, 0));
+        }
+        free_operands(&dense);
+        free_operands(&structured);
     }
-    #pragma acc exit data delete(A[:dim*dim], B[:dim*dim]) copyout(C[:dim*dim])
-    printf("Check that value is equal to 42.: %f\n", C[0]);
     return 0;
 }
-
@@ -0,0 +1,220 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+/**
+ * Empirical tuning of the parameters of a kernel (tile sizes, loop orders...)
+ *
+ * A configuration is a small array of integers. The kernel is run for each
+ * candidate configuration with bench_measure (bench.h): first without
+ * timing (warm-up), then several times, and the median time is kept. The
+ * best configuration is stored in the cache file AUTOTUNE_CACHE with one
+ * line per host and kernel:
+ *     host kernel value1 value2 ...
+ * so the same file can serve several machines. The programs load their
+ * configuration at startup and keep their default when the cache has none
+ * for the current host.
+ *
+ * List of functions:
+ *   - double autotune_time(bench_kernel setup, autotune_kernel run, const int* config, void* data,
+ *                          int warmup, int repetitions)
+ *     median time of the repetitions of the kernel for one configuration
+ *   - int autotune_search(const char* kernel, const char* names, bench_kernel setup, autotune_kernel run,
+ *                         void* data, const int* candidates, int count, int size, int warmup, int repetitions)
+ *     time the count candidates of size values, save the best one and return its index
+ *   - int autotune_load(const char* kernel, int* config, int size, const int* lower, const int* upper)
+ *     read the configuration of the kernel for the current host, return 1 if
+ *     found with every value in [lower, upper]
+ *   - int autotune_save(const char* kernel, const int* config, int size)
+ *     write the configuration of the kernel for the current host, return 0 on success
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+
+#ifndef AUTOTUNE_CACHE
+#define AUTOTUNE_CACHE "autotune.cache"
+#endif
+#define AUTOTUNE_LINE 1024
+
+// Kernel to tune: run once with the given configuration on the data
+typedef void (*autotune_kernel)(const int* config, void* data);
+
+// Setup, kernel and configuration timed by bench_measure
+typedef struct
+{
+    bench_kernel setup;
+    autotune_kernel run;
+    const int* config;
+    void* data;
+} autotune_call;
+
+void autotune_setup(void* call)
+{
+    autotune_call* c = (autotune_call*) call;
+    c->setup(c->data);
+}
+
+void autotune_run(void* call)
+{
+    autotune_call* c = (autotune_call*) call;
+    c->run(c->config, c->data);
+}
+
+double autotune_time(bench_kernel setup, autotune_kernel run, const int* config, void* data, int warmup,
+                     int repetitions)
+{
+    /**
+     * Time the kernel for one configuration
+     * @param setup: called on the data before each run and not timed, or NULL
+     * @param run: the kernel
+     * @param config: the configuration
+     * @param data: the data of the kernel
+     * @param warmup: the number of runs which are not timed
+     * @param repetitions: the number of runs timed
+     * @return the median time in seconds
+     */
+    autotune_call call = {setup, run, config, data};
+    bench_stats stats;
+    bench_measure(setup != NULL ? autotune_setup : NULL, autotune_run, &call, warmup, repetitions, &stats);
+    return stats.median;
+}
+
+int autotune_match(const char* line, const char* host, const char* kernel, const char** values)
+{
+    /**
+     * Check if a line of the cache is the one of the host and the kernel
+     * @param values(out): the rest of the line
+     */
+    char line_host[256], line_kernel[256];
+    int n = 0;
+    if (sscanf(line, "%255s %255s %n", line_host, line_kernel, &n) != 2 || n == 0)
+        return 0;
+    *values = line + n;
+    return strcmp(line_host, host) == 0 && strcmp(line_kernel, kernel) == 0;
+}
+
+int autotune_load(const char* kernel, int* config, int size, const int* lower, const int* upper)
+{
+    /**
+     * Read the configuration of a kernel for the current host
+     * The cache is a text file which can be edited: a line with a value out
+     * of its range (a tile of 0 would never end a loop) is ignored.
+     * @param kernel: the name of the kernel (no space)
+     * @param config(out): the configuration, unchanged if there is none
+     * @param size: the number of values of the configuration
+     * @param lower, upper: the smallest and the largest valid value of each element
+     * @return 1 if a valid configuration was found
+     */
+    char host[256] = "unknown";
+    char line[AUTOTUNE_LINE];
+    int found = 0;
+    gethostname(host, sizeof(host)-1);
+    FILE* f = fopen(AUTOTUNE_CACHE, "r");
+    if (f == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        const char* values;
+        if (!autotune_match(line, host, kernel, &values))
+            continue;
+        int read[size > 0 ? size : 1];
+        int k = 0;
+        for (char* end; k < size; ++k, values = end)
+        {
+            read[k] = (int) strtol(values, &end, 10);
+            if (end == values)
+                break;
+            if (read[k] < lower[k] || read[k] > upper[k])
+            {
+                fprintf(stderr, "Warning: %s = %d out of [%d, %d] in %s, entry ignored\n", kernel, read[k],
+                        lower[k], upper[k], AUTOTUNE_CACHE);
+                break;
+            }
+        }
+        if (k == size)
+        {
+            memcpy(config, read, size*sizeof(int));
+            found = 1;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+int autotune_save(const char* kernel, const int* config, int size)
+{
+    /**
+     * Write the configuration of a kernel for the current host
+     * The lines of the other hosts and kernels are kept. The new file
+     * replaces the old one at once (rename).
+     * @return 0 on success
+     */
+    char host[256] = "unknown";
+    char line[AUTOTUNE_LINE];
+    gethostname(host, sizeof(host)-1);
+    FILE* out = fopen(AUTOTUNE_CACHE ".tmp", "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", AUTOTUNE_CACHE ".tmp");
+        return 1;
+    }
+    FILE* in = fopen(AUTOTUNE_CACHE, "r");
+    while (in != NULL && fgets(line, sizeof(line), in) != NULL)
+    {
+        const char* values;
+        if (!autotune_match(line, host, kernel, &values))
+            fputs(line, out);
+    }
+    if (in != NULL)
+        fclose(in);
+    fprintf(out, "%s %s", host, kernel);
+    for (int k=0; k < size; ++k)
+        fprintf(out, " %d", config[k]);
+    fprintf(out, "\n");
+    if (fclose(out) != 0 || rename(AUTOTUNE_CACHE ".tmp", AUTOTUNE_CACHE) != 0)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", AUTOTUNE_CACHE);
+        return 1;
+    }
+    return 0;
+}
+
+int autotune_search(const char* kernel, const char* names, bench_kernel setup, autotune_kernel run,
+                    void* data, const int* candidates, int count, int size, int warmup, int repetitions)
+{
+    /**
+     * Time all the candidates and save the fastest one in the cache
+     * @param kernel: the name of the kernel in the cache
+     * @param names: the names of the values, to print the candidates
+     * @param setup, run, data: see autotune_time
+     * @param candidates: count configurations of size values one after the other
+     * @return the index of the best candidate
+     */
+    int best = 0;
+    double best_time = 0.;
+    printf("Tuning %s: %d candidates, %d warm-up and %d timed runs each\n", kernel, count, warmup, repetitions);
+    for (int c=0; c < count; ++c)
+    {
+        const double t = autotune_time(setup, run, candidates + c*size, data, warmup, repetitions);
+        printf("  %s =", names);
+        for (int k=0; k < size; ++k)
+            printf(" %5d", candidates[c*size + k]);
+        printf(": %10.5e s\n", t);
+        if (c == 0 || t < best_time)
+        {
+            best = c;
+            best_time = t;
+        }
+    }
+    printf("Best %s =", names);
+    for (int k=0; k < size; ++k)
+        printf(" %d", candidates[best*size + k]);
+    printf(" (%10.5e s)", best_time);
+    if (autotune_save(kernel, candidates + best*size, size) == 0)
+        printf(", saved in %s", AUTOTUNE_CACHE);
+    printf("\n");
+    return best;
+}
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef BENCH_H
+#define BENCH_H
+/**
+ * Benchmark harness
+ *
+ * The variants of a kernel are registered with the number of floating point
+ * operations and of bytes moved by one run. Each variant is run warmup times
+ * without timing (page faults, caches, frequency, GPU context), then
+ * repetitions times, timed with the monotonic wall clock: clock() is the CPU
+ * time of the process, which adds the time of the threads and misses the time
+ * waiting for a GPU. The setup of a variant (e.g. setting the output to 0) is
+ * called before each run and is not timed. The check of a variant (e.g. a
+ * checksum or a number of errors) is called after the last run and compared
+ * with the check of the first variant, the reference (relative difference,
+ * or absolute when the reference is 0): the variant is wrong when the
+ * difference is above the tolerance of the benchmark (1e-12 by default).
+ *
+ * The results (median, min and standard deviation of the time, GFLOP/s and
+ * GB/s from the median) are printed as a table, CSV or JSON. The programs pass
+ * their arguments to bench_option: "csv", "json", "warmup=N" and "reps=N".
+ *
+ * List of functions:
+ *   - double bench_now(void)
+ *     wall clock time in seconds
+ *   - void bench_measure(bench_kernel setup, bench_kernel run, void* data, int warmup, int repetitions,
+ *                        bench_stats* stats)
+ *     time a kernel
+ *   - void bench_init(bench* b, const char* name)
+ *     start a benchmark with 1 warm-up and 3 timed runs per variant
+ *   - int bench_option(bench* b, const char* arg)
+ *     apply an option of the command line, return 0 if arg is not an option
+ *   - void bench_add(bench* b, const char* name, bench_kernel setup, bench_kernel run, bench_check check,
+ *                    void* data, double flops, double bytes)
+ *     register a variant (setup and check may be NULL)
+ *   - void bench_run(bench* b)
+ *     measure all the variants and print the results
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define BENCH_MAX_VARIANTS 32
+enum { BENCH_TEXT, BENCH_CSV, BENCH_JSON };
+
+// Kernel of a variant and its setup, run with the data of the variant
+typedef void (*bench_kernel)(void* data);
+// Check of the result of a variant
+typedef double (*bench_check)(void* data);
+
+typedef struct
+{
+    double median;
+    double min;
+    double max;
+    double mean;
+    double stddev;
+} bench_stats;
+
+typedef struct
+{
+    const char* name;
+    bench_kernel setup;
+    bench_kernel run;
+    bench_check check;
+    void* data;
+    double flops;
+    double bytes;
+    bench_stats stats;
+    double result;
+} bench_variant;
+
+typedef struct
+{
+    const char* name;
+    int warmup;
+    int repetitions;
+    int format;
+    double tolerance;
+    int count;
+    bench_variant variants[BENCH_MAX_VARIANTS];
+} bench;
+
+double bench_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+    return t.tv_sec + t.tv_nsec / 1.e9;
+}
+
+int bench_compare(const void* a, const void* b)
+{
+    const double x = *(const double*) a;
+    const double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+void bench_measure(bench_kernel setup, bench_kernel run, void* data, int warmup, int repetitions,
+                   bench_stats* stats)
+{
+    /**
+     * Time a kernel
+     * @param setup: called before each run and not timed, or NULL
+     * @param run: the kernel
+     * @param data: the argument of setup and run
+     * @param warmup: the number of runs which are not timed
+     * @param repetitions: the number of runs timed (at least 1)
+     * @param stats(out): the statistics of the times in seconds
+     */
+    if (repetitions < 1)
+        repetitions = 1;
+    double* times = (double*) malloc(repetitions*sizeof(double));
+    for (int r=0; r < warmup + repetitions; ++r)
+    {
+        if (setup != NULL)
+            setup(data);
+        const double start = bench_now();
+        run(data);
+        if (r >= warmup)
+            times[r-warmup] = bench_now() - start;
+    }
+    qsort(times, repetitions, sizeof(double), bench_compare);
+    stats->min = times[0];
+    stats->max = times[repetitions-1];
+    stats->median = repetitions % 2 ? times[repetitions/2] : 0.5*(times[repetitions/2-1] + times[repetitions/2]);
+    stats->mean = 0.;
+    for (int r=0; r < repetitions; ++r)
+        stats->mean += times[r] / repetitions;
+    stats->stddev = 0.;
+    for (int r=0; r < repetitions; ++r)
+        stats->stddev += (times[r] - stats->mean)*(times[r] - stats->mean);
+    stats->stddev = repetitions > 1 ? sqrt(stats->stddev / (repetitions-1)) : 0.;
+    free(times);
+}
+
+void bench_init(bench* b, const char* name)
+{
+    b->name = name;
+    b->warmup = 1;
+    b->repetitions = 3;
+    b->format = BENCH_TEXT;
+    b->tolerance = 1.e-12;
+    b->count = 0;
+}
+
+int bench_option(bench* b, const char* arg)
+{
+    /**
+     * Apply an option of the command line: csv, json, warmup=N or reps=N
+     * @return 1 if arg is an option of the harness
+     */
+    if (strcmp(arg, "csv") == 0)
+        b->format = BENCH_CSV;
+    else if (strcmp(arg, "json") == 0)
+        b->format = BENCH_JSON;
+    else if (strncmp(arg, "warmup=", 7) == 0)
+        b->warmup = atoi(arg+7);
+    else if (strncmp(arg, "reps=", 5) == 0)
+        b->repetitions = atoi(arg+5);
+    else
+        return 0;
+    return 1;
+}
+
+void bench_add(bench* b, const char* name, bench_kernel setup, bench_kernel run, bench_check check,
+               void* data, double flops, double bytes)
+{
+    /**
+     * Register a variant
+     * @param name: the name of the variant (no comma or quote)
+     * @param setup: called before each run and not timed, or NULL
+     * @param run: the kernel
+     * @param check: called after the last run, or NULL
+     * @param data: the argument of setup, run and check
+     * @param flops, bytes: the floating point operations and the bytes moved by one run
+     */
+    if (b->count == BENCH_MAX_VARIANTS)
+    {
+        fprintf(stderr, "Error: more than %d variants in %s\n", BENCH_MAX_VARIANTS, b->name);
+        return;
+    }
+    bench_variant* v = &b->variants[b->count++];
+    v->name = name;
+    v->setup = setup;
+    v->run = run;
+    v->check = check;
+    v->data = data;
+    v->flops = flops;
+    v->bytes = bytes;
+}
+
+void bench_run(bench* b)
+{
+    /**
+     * Measure all the variants in the order of registration and print the results
+     * The check of each variant is compared with the one of the first variant.
+     */
+    double reference = NAN;
+    if (b->format == BENCH_TEXT)
+        printf("%s: %d warm-up and %d timed runs\n%-28s %12s %12s %12s %9s %9s %20s %9s\n", b->name, b->warmup,
+               b->repetitions, "variant", "median (s)", "min (s)", "stddev (s)", "GFLOP/s", "GB/s", "check",
+               "diff");
+    else if (b->format == BENCH_CSV)
+        printf("benchmark,variant,warmup,repetitions,median_s,min_s,stddev_s,gflops,gbs,check,correct\n");
+    else
+        printf("{\"benchmark\": \"%s\", \"warmup\": %d, \"repetitions\": %d, \"variants\": [", b->name, b->warmup,
+               b->repetitions);
+    for (int k=0; k < b->count; ++k)
+    {
+        bench_variant* v = &b->variants[k];
+        bench_measure(v->setup, v->run, v->data, b->warmup, b->repetitions, &v->stats);
+        v->result = v->check == NULL ? NAN : v->check(v->data);
+        if (k == 0)
+            reference = v->result;
+        const double diff = reference != 0. ? fabs(v->result - reference) / fabs(reference)
+                                            : fabs(v->result);
+        const int correct = diff <= b->tolerance;
+        const double gflops = v->flops / v->stats.median / 1.e9;
+        const double gbs = v->bytes / v->stats.median / 1.e9;
+        if (b->format == BENCH_TEXT)
+        {
+            printf("%-28s %12.5e %12.5e %12.5e %9.3f %9.3f", v->name, v->stats.median, v->stats.min,
+                   v->stats.stddev, gflops, gbs);
+            if (v->check != NULL)
+                printf(" %20.10g %9.2e %s", v->result, diff, correct ? "OK" : "WRONG");
+            printf("\n");
+        }
+        else if (b->format == BENCH_CSV)
+        {
+            printf("%s,%s,%d,%d,%.6e,%.6e,%.6e,%.6f,%.6f,", b->name, v->name, b->warmup, b->repetitions,
+                   v->stats.median, v->stats.min, v->stats.stddev, gflops, gbs);
+            if (v->check != NULL)
+                printf("%.17g,%d", v->result, correct);
+            else
+                printf(",");
+            printf("\n");
+        }
+        else
+        {
+            printf("%s\n  {\"variant\": \"%s\", \"median_s\": %.6e, \"min_s\": %.6e, \"stddev_s\": %.6e, "
+                   "\"gflops\": %.6f, \"gbs\": %.6f", k > 0 ? "," : "", v->name, v->stats.median, v->stats.min,
+                   v->stats.stddev, gflops, gbs);
+            if (v->check != NULL)
+                printf(", \"check\": %.17g, \"correct\": %s", v->result, correct ? "true" : "false");
+            printf("}");
+        }
+        fflush(stdout);
+    }
+    if (b->format == BENCH_JSON)
+        printf("\n]}\n");
+}
+
+#endif
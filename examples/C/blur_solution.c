@@ -2,31 +2,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#pragma acc routine seq
-unsigned char weight(unsigned char* pic, int x, int y, int l, size_t cols)
-{
-   /**
-    * Compute the weight of the blurred pixel
-    * @param pic(in): a pointer to the pixel to be blurred
-    * @param x(in): the x coordinate of the pixel
-    * @param y(in): the y coordinate of the pixel
-    * @param l(in): the color coordinate of the pixel (0 for R, 1 for G, 2 for B)
-    * @param cols(in) the number of columns in the picture
-    * @return the weight of the blurred pixel
-    */
-   unsigned char coefs[5][5] = { {1,  4,  6,  4,  1},
-                                 {4, 16, 24, 16,  4},
-                                 {6, 24, 36, 24,  6},
-                                 {4, 16, 24, 16,  4},
-                                 {1,  4,  6,  4,  1}};
-   int i, j;
-   int pix = 0;
-#pragma acc loop collapse(2) reduction(+:pix) 
-   for (i=0; i<5; ++i)
-      for (j=0; j<5; ++j)
-         pix += pic[(x+i-2)*3*cols+y*3+l-2+j]*coefs[i][j];
-   return (unsigned char) (pix/256);
-}
+#include <stdint.h>
+#include <pthread.h>
+#if defined(__SSE2__) && defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+#include "mmap_io.h"
+#include "filters.h"
+#include "bench.h"
+
+// Size of the tiles used by blur_tiled.
+// (TILE_ROWS+4) source rows of 3*(TILE_COLS+4) bytes have to fit in the L2 cache
+#ifndef TILE_ROWS
+#define TILE_ROWS 64
+#endif
+#ifndef TILE_COLS
+#define TILE_COLS 1024
+#endif
+// Number of rows produced per stripe and number of stripes in flight
+// by blur_stream. The memory used is about 2*STRIPES*(STRIPE_ROWS+4)*3*cols
+#ifndef STRIPE_ROWS
+#define STRIPE_ROWS 64
+#endif
+#define STRIPES 3
+#define MIN(a,b) ( ((a)<(b))?(a):(b) )
+
+#define STENCIL_NAME blur_stencil
+#define STENCIL_TYPE unsigned char
+#define STENCIL_RADIUS BLUR_RADIUS
+#define STENCIL_CHANNELS 1
+#define STENCIL_COEFS BLUR_COEFS
+#define STENCIL_FINALIZE(pix, center) BLUR_FINALIZE(pix)
+#define STENCIL_ASYNC 2
+#include "stencil.h"
 
 void blur(unsigned char* pic,  unsigned char* blurred, size_t rows, size_t cols)
 {
@@ -35,14 +43,323 @@ void blur(unsigned char* pic,  unsigned char* blurred, size_t rows, size_t cols)
      * @ param pic(in): a pointer to the original picture
      * @ param blurred(out): a pointer to the blurred picture
      */
-   size_t i, j, l;
-#pragma acc parallel loop present(blurred[:rows*3*cols], pic[:rows*3*cols]) async(2)\
-   num_gangs(200) 
-   for (i=2; i<rows-2; ++i)
-#pragma acc loop independent collapse(2)
-      for (j=2; j<cols-2; ++j)
-         for (l=0; l<3; ++l)
-            blurred[i*3*cols+j*3+l] = weight(pic, i, j, l, cols);
+   blur_stencil_rows(pic, blurred, 2, rows-2, 6, 3*cols-6, 3*cols);
+}
+
+unsigned char byte_sum(const unsigned char* restrict data, size_t n)
+{
+    /**
+     * Compute the sum of n bytes modulo 256
+     * On x86 psadbw against zero adds 8 bytes at once in each 64-bit lane
+     * @param data(in): a pointer to the bytes
+     * @param n(in): the number of bytes
+     * @return the sum modulo 256
+     */
+   uint64_t sum = 0;
+   size_t j = 0;
+#if defined(__SSE2__) && defined(__x86_64__)
+   const __m128i zero = _mm_setzero_si128();
+   __m128i acc = _mm_setzero_si128();
+   for (; j+16 <= n; j += 16)
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*) (data+j)), zero));
+   sum = (uint64_t) _mm_cvtsi128_si64(acc) + (uint64_t) _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+#endif
+   for (; j < n; ++j)
+      sum += data[j];
+   return (unsigned char) sum;
+}
+
+unsigned int checksum_finalize(unsigned int sum1)
+{
+    /**
+     * Mix the sum of the row checksums as checksum does
+     */
+   unsigned int val=42424242;
+   return ((sum1 ^ val)<<8)+sum1;
+}
+
+void blur_tile(const unsigned char* restrict pic, unsigned char* restrict blurred,
+               size_t r0, size_t r1, size_t c0, size_t c1, size_t cols,
+               unsigned char* restrict sums, size_t sums_stride)
+{
+    /**
+     * Perform the blurring of one tile of the picture on the host
+     * The 5x5 kernel is the outer product of {1, 4, 6, 4, 1} with itself so it
+     * is applied as a vertical pass followed by an horizontal one.
+     * The partial sums are at most 256*255 so they fit in 16-bit lanes.
+     * @param pic(in): a pointer to the original picture
+     * @param blurred(out): a pointer to the blurred picture
+     * @param r0, r1(in): the range of rows [r0, r1[ of the tile
+     * @param c0, c1(in): the range of columns [c0, c1[ of the tile
+     * @param cols(in) the number of columns in the picture
+     * @param sums(out): if not NULL, the sum modulo 256 of the bytes of the
+     *                   row r0+k of the tile is stored in sums[k*sums_stride]
+     */
+   const size_t width = 3*(c1-c0);
+   // Vertical sums of the tile row plus the 2 bytes halo on each side
+   uint16_t vert[3*TILE_COLS+4];
+   for (size_t i=r0; i<r1; ++i)
+   {
+      const unsigned char* restrict p0 = pic + (i-2)*3*cols + 3*c0 - 2;
+      const unsigned char* restrict p1 = p0 + 3*cols;
+      const unsigned char* restrict p2 = p1 + 3*cols;
+      const unsigned char* restrict p3 = p2 + 3*cols;
+      const unsigned char* restrict p4 = p3 + 3*cols;
+      unsigned char* restrict out = blurred + i*3*cols + 3*c0;
+#pragma omp simd
+      for (size_t b=0; b<width+4; ++b)
+         vert[b] = (uint16_t) (p0[b] + 4*p1[b] + 6*p2[b] + 4*p3[b] + p4[b]);
+#pragma omp simd
+      for (size_t b=0; b<width; ++b)
+         out[b] = (unsigned char) ((uint16_t) (vert[b] + 4*vert[b+1] + 6*vert[b+2]
+                                               + 4*vert[b+3] + vert[b+4]) >> 8);
+      // The row of the tile is still in the L1 cache
+      if (sums != NULL)
+         sums[(i-r0)*sums_stride] = byte_sum(out, width);
+   }
+}
+
+unsigned int blur_rows_tiled(unsigned char* pic,  unsigned char* blurred, size_t r0, size_t r1,
+                             size_t cols, int with_checksum)
+{
+    /**
+     * Perform the blurring of the rows [r0, r1[ on the host tile by tile
+     * @ param pic(in): a pointer to the original picture
+     * @ param blurred(out): a pointer to the blurred picture
+     * @ param r0, r1(in): the range of rows to compute (2 <= r0, r1 <= rows-2)
+     * @ param cols(in) the number of columns in the picture
+     * @ param with_checksum(in) compute the checksum of the rows while they are produced
+     * @ return the sum of the row checksums (see checksum) or 0
+     */
+   const size_t ntiles = (cols-4+TILE_COLS-1)/TILE_COLS;
+   unsigned char* sums = NULL;
+   unsigned int sum1 = 0;
+   if (with_checksum)
+      sums = (unsigned char*) malloc((r1-r0)*ntiles*sizeof(unsigned char));
+#pragma omp parallel for collapse(2) schedule(static)
+   for (size_t ti=r0; ti<r1; ti+=TILE_ROWS)
+      for (size_t tj=2; tj<cols-2; tj+=TILE_COLS)
+         blur_tile(pic, blurred, ti, MIN(ti+TILE_ROWS, r1),
+                   tj, MIN(tj+TILE_COLS, cols-2), cols,
+                   sums ? sums + (ti-r0)*ntiles + (tj-2)/TILE_COLS : NULL, ntiles);
+   if (sums != NULL)
+   {
+      // The checksum of a row is the sum modulo 256 of the sums of its tiles
+#pragma omp parallel for reduction(+:sum1) schedule(static)
+      for (size_t i=0; i < r1-r0; ++i)
+      {
+         unsigned char sum2 = 0;
+         for (size_t t=0; t < ntiles; ++t)
+            sum2 += sums[i*ntiles+t];
+         sum1 += sum2;
+      }
+      free(sums);
+   }
+   return sum1;
+}
+
+void blur_tiled(unsigned char* pic,  unsigned char* blurred, size_t rows, size_t cols)
+{
+    /**
+     * Perform the blurring of the picture on the host tile by tile
+     * Gives the same result as blur
+     * @ param pic(in): a pointer to the original picture
+     * @ param blurred(out): a pointer to the blurred picture
+     */
+   blur_rows_tiled(pic, blurred, 2, rows-2, cols, 0);
+}
+
+unsigned int blur_tiled_checksum(unsigned char* pic,  unsigned char* blurred, size_t rows, size_t cols)
+{
+    /**
+     * Perform the blurring of the picture on the host tile by tile and
+     * compute the checksum of the blurred picture at the same time
+     * @ param pic(in): a pointer to the original picture
+     * @ param blurred(out): a pointer to the blurred picture
+     * @ return the same value as checksum(blurred, rows, cols)
+     */
+   return checksum_finalize(blur_rows_tiled(pic, blurred, 2, rows-2, cols, 1));
+}
+
+typedef struct
+{
+   FILE* in;  // the original picture
+   FILE* out; // the blurred picture
+   size_t rows;
+   size_t cols;
+   size_t nstripes;
+   // Stripe k uses the slot k%STRIPES. Both buffers hold STRIPE_ROWS+4 rows,
+   // row 0 being the row k*STRIPE_ROWS-2 of the picture
+   unsigned char* in_buf[STRIPES];
+   unsigned char* out_buf[STRIPES];
+   // Number of stripes read, blurred and written so far
+   size_t read;
+   size_t blurred;
+   size_t written;
+   // Sum of the row checksums of the stripes blurred so far
+   unsigned int sum1;
+   int error;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+} stream;
+
+int stream_wait(stream* s, size_t* counter, size_t value)
+{
+    /**
+     * Wait until *counter > value or an error occured in another stage
+     * @return a non zero value in case of error
+     */
+   pthread_mutex_lock(&s->lock);
+   while (*counter <= value && !s->error)
+      pthread_cond_wait(&s->cond, &s->lock);
+   int error = s->error;
+   pthread_mutex_unlock(&s->lock);
+   return error;
+}
+
+void stream_done(stream* s, size_t* counter, int error)
+{
+    /**
+     * Signal that one more stripe went through a stage
+     */
+   pthread_mutex_lock(&s->lock);
+   ++*counter;
+   s->error |= error;
+   pthread_cond_broadcast(&s->cond);
+   pthread_mutex_unlock(&s->lock);
+}
+
+void* stream_reader(void* arg)
+{
+    /**
+     * Read the stripes of the original picture with 2 rows of overlap
+     * on each side
+     */
+   stream* s = (stream*) arg;
+   const size_t row_size = 3*s->cols;
+   for (size_t k=0; k < s->nstripes; ++k)
+   {
+      // Wait for the slot to be released by the blur stage
+      if (k >= STRIPES && stream_wait(s, &s->blurred, k-STRIPES)) break;
+      size_t first = k*STRIPE_ROWS;
+      size_t begin = first >= 2 ? first-2 : 0;
+      size_t end = MIN(first+STRIPE_ROWS+2, s->rows);
+      unsigned char* buf = s->in_buf[k%STRIPES] + (begin+2-first)*row_size;
+      int error = fseeko(s->in, (off_t) begin*row_size, SEEK_SET) != 0
+               || fread(buf, 1, (end-begin)*row_size, s->in) != (end-begin)*row_size;
+      stream_done(s, &s->read, error);
+   }
+   return NULL;
+}
+
+void* stream_blur(void* arg)
+{
+    /**
+     * Blur the stripes. The border of the picture is copied from the original
+     */
+   stream* s = (stream*) arg;
+   const size_t row_size = 3*s->cols;
+   for (size_t k=0; k < s->nstripes; ++k)
+   {
+      if (stream_wait(s, &s->read, k)) break;
+      if (k >= STRIPES && stream_wait(s, &s->written, k-STRIPES)) break;
+      unsigned char* in = s->in_buf[k%STRIPES];
+      unsigned char* out = s->out_buf[k%STRIPES];
+      size_t first = k*STRIPE_ROWS;
+      size_t last = MIN(first+STRIPE_ROWS, s->rows);
+      // Global rows [r0, r1[ of the stripe are in the inner part of the picture
+      size_t r0 = first > 2 ? first : 2;
+      size_t r1 = MIN(last, s->rows-2);
+      for (size_t i=first; i < last; ++i)
+      {
+         size_t li = i+2-first;
+         if (i < r0 || i >= r1)
+            memcpy(out+li*row_size, in+li*row_size, row_size);
+         else
+         {
+            memcpy(out+li*row_size, in+li*row_size, 6);
+            memcpy(out+li*row_size+row_size-6, in+li*row_size+row_size-6, 6);
+         }
+      }
+      if (r0 < r1)
+         s->sum1 += blur_rows_tiled(in, out, r0+2-first, r1+2-first, s->cols, 1);
+      stream_done(s, &s->blurred, 0);
+   }
+   return NULL;
+}
+
+void* stream_writer(void* arg)
+{
+    /**
+     * Write the blurred stripes sequentially
+     */
+   stream* s = (stream*) arg;
+   const size_t row_size = 3*s->cols;
+   for (size_t k=0; k < s->nstripes; ++k)
+   {
+      if (stream_wait(s, &s->blurred, k)) break;
+      size_t first = k*STRIPE_ROWS;
+      size_t n = MIN(first+STRIPE_ROWS, s->rows) - first;
+      int error = fwrite(s->out_buf[k%STRIPES]+2*row_size, 1, n*row_size, s->out) != n*row_size;
+      stream_done(s, &s->written, error);
+   }
+   return NULL;
+}
+
+int blur_stream(char* in_name, char* out_name, size_t rows, size_t cols)
+{
+    /**
+     * Blur a picture stored in a file without loading it entirely in memory
+     * The picture is processed by stripes of STRIPE_ROWS rows. Reading,
+     * blurring and writing are done by three threads working on different
+     * stripes so the memory needed does not depend on the number of rows.
+     * @param in_name(in): the path of the original picture (.rgb)
+     * @param out_name(in): the path of the blurred picture (.rgb)
+     * @param rows(in) the number of rows in the picture
+     * @param cols(in) the number of columns in the picture
+     * @return 0 on success
+     */
+   stream s = {.rows=rows, .cols=cols, .nstripes=(rows+STRIPE_ROWS-1)/STRIPE_ROWS};
+   pthread_t reader, blurrer, writer;
+
+   s.in = fopen(in_name, "rb");
+   s.out = fopen(out_name, "wb");
+   if (s.in == NULL || s.out == NULL)
+   {
+      fprintf(stderr, "Error: cannot open %s or %s\n", in_name, out_name);
+      if (s.in) fclose(s.in);
+      if (s.out) fclose(s.out);
+      return 1;
+   }
+   for (int k=0; k < STRIPES; ++k)
+   {
+      s.in_buf[k] = (unsigned char*) malloc((STRIPE_ROWS+4)*3*cols*sizeof(unsigned char));
+      s.out_buf[k] = (unsigned char*) malloc((STRIPE_ROWS+4)*3*cols*sizeof(unsigned char));
+   }
+   pthread_mutex_init(&s.lock, NULL);
+   pthread_cond_init(&s.cond, NULL);
+
+   pthread_create(&reader, NULL, stream_reader, &s);
+   pthread_create(&blurrer, NULL, stream_blur, &s);
+   pthread_create(&writer, NULL, stream_writer, &s);
+   pthread_join(reader, NULL);
+   pthread_join(blurrer, NULL);
+   pthread_join(writer, NULL);
+
+   if (s.error)
+      fprintf(stderr, "Error while reading %s or writing %s\n", in_name, out_name);
+   else
+      printf("Checksum 0x%x\n", checksum_finalize(s.sum1));
+   pthread_mutex_destroy(&s.lock);
+   pthread_cond_destroy(&s.cond);
+   for (int k=0; k < STRIPES; ++k)
+   {
+      free(s.in_buf[k]);
+      free(s.out_buf[k]);
+   }
+   fclose(s.in);
+   if (fclose(s.out) != 0) s.error = 1;
+   return s.error;
 }
 void fill(unsigned char* pic, size_t rows, size_t cols)
 {
@@ -96,7 +413,6 @@ unsigned int checksum(unsigned char* pic, size_t rows, size_t cols)
      */
     unsigned int sum1=0;
     unsigned int sum2=0;
-    unsigned int val=42424242;
 #pragma acc parallel loop present(pic[:3*cols*rows]) reduction(+:sum1) firstprivate(sum2) wait(2)
     for (size_t i=2; i < rows-2; ++i)
     {
@@ -109,7 +425,7 @@ unsigned int checksum(unsigned char* pic, size_t rows, size_t cols)
 
         sum1 += sum2 % 256 ;
     }
-    return ((sum1 ^ val)<<8)+sum1;
+    return checksum_finalize(sum1);
 }
 void free_pic(unsigned char* pic, size_t rows, size_t cols)
 {
@@ -123,13 +439,190 @@ void free_pic(unsigned char* pic, size_t rows, size_t cols)
    free(pic);
 }
 
+int blur_mapped(char* in_name, char* out_name, size_t rows, size_t cols, int tiled)
+{
+    /**
+     * Blur a picture stored in a file. Both files are mapped in memory so
+     * the filter reads and writes the page cache directly.
+     * @param in_name(in): the path of the original picture (.rgb)
+     * @param out_name(in): the path of the blurred picture (.rgb)
+     * @param rows(in) the number of rows in the picture
+     * @param cols(in) the number of columns in the picture
+     * @param tiled(in) use the tiled host version of the filter
+     * @return 0 on success
+     */
+   size_t size = rows*3*cols;
+   unsigned char* pic = map_input(in_name, size);
+   unsigned char* blurred_pic = pic != NULL ? map_output(out_name, size) : NULL;
+   if (blurred_pic == NULL)
+   {
+      unmap(pic, size);
+      return 1;
+   }
+   unsigned int check;
+   if (tiled)
+       check = blur_tiled_checksum(pic, blurred_pic, rows, cols);
+   else
+   {
+#pragma acc enter data copyin(pic[:size]) create(blurred_pic[:size])
+       blur(pic, blurred_pic, rows, cols);
+       check = checksum(blurred_pic, rows, cols);
+#pragma acc update self(blurred_pic[:size]) wait(2)
+#pragma acc exit data delete(pic[:size], blurred_pic[:size])
+   }
+   printf("Checksum 0x%x\n", check);
+   unmap(pic, size);
+   unmap(blurred_pic, size);
+   return 0;
+}
+
+// Pictures of one size of the benchmark
+typedef struct
+{
+   size_t size;
+   unsigned char* pic;
+   unsigned char* naive;
+   unsigned char* tiled;
+} blur_problem;
+
+void run_blur(void* data)
+{
+   blur_problem* p = (blur_problem*) data;
+   unsigned char* naive = p->naive;
+   blur(p->pic, naive, p->size, p->size);
+   // The blurred picture is written back to the host, as the one of blur_tiled
+#pragma acc update self(naive[0:p->size*3*p->size]) wait(2)
+}
+
+void run_blur_tiled(void* data)
+{
+   blur_problem* p = (blur_problem*) data;
+   blur_tiled(p->pic, p->tiled, p->size, p->size);
+}
+
+double inner_checksum(const unsigned char* pic, size_t size)
+{
+    /**
+     * Checksum of the inner part of a square picture (the border is not computed)
+     * Each byte is weighted by its position, so a moved or swapped pixel
+     * changes the sum. The sum wraps around modulo 2^64 and is truncated to
+     * 52 bits to be exact in a double.
+     */
+   uint64_t sum = 0;
+   for (size_t i=2; i < size-2; ++i)
+   {
+      uint64_t row = 0;
+      for (size_t j=6; j < 3*(size-2); ++j)
+         row += (uint64_t) (j+1) * pic[i*3*size+j];
+      sum += (uint64_t) (i+1) * row;
+   }
+   return (double) (sum & (((uint64_t) 1 << 52) - 1));
+}
+
+double check_blur(void* data)
+{
+   blur_problem* p = (blur_problem*) data;
+   return inner_checksum(p->naive, p->size);
+}
+
+double check_blur_tiled(void* data)
+{
+   blur_problem* p = (blur_problem*) data;
+   return inner_checksum(p->tiled, p->size);
+}
+
+void benchmark(size_t max_size, int argc, char** argv)
+{
+    /**
+     * Compare the bandwidth of blur and blur_tiled on square pictures
+     * from 1024x1024 to max_size x max_size
+     * The bandwidth counts one read of the original picture and one write of
+     * the blurred picture. The check is a checksum of the inner part of the
+     * blurred picture weighted by the positions: blur_tiled must give the
+     * same value as blur.
+     * @param max_size(in) the size of the largest picture
+     * @param argc, argv(in) the options of the benchmark harness
+     */
+   for (size_t size=1024; size <= max_size; size *= 2)
+   {
+      unsigned char* pic = allocate(size, size);
+      unsigned char* naive = allocate(size, size);
+      unsigned char* tiled = allocate(size, size);
+      if (pic == NULL || naive == NULL || tiled == NULL)
+      {
+         printf("%8zu not enough memory\n", size);
+         free_pic(pic, size, size);
+         free_pic(naive, size, size);
+         free_pic(tiled, size, size);
+         break;
+      }
+      fill(pic, size, size);
+#pragma acc update self(pic[0:size*3*size])
+      blur_problem problem = {size, pic, naive, tiled};
+      const double bytes = 2. * size * 3 * size;
+      char name[64];
+      snprintf(name, sizeof(name), "blur %zu x %zu", size, size);
+      bench bench;
+      bench_init(&bench, name);
+      bench.tolerance = 0.;
+      for (int arg=0; arg < argc; ++arg)
+         bench_option(&bench, argv[arg]);
+      bench_add(&bench, "naive", NULL, run_blur, check_blur, &problem, 0., bytes);
+      bench_add(&bench, "tiled", NULL, run_blur_tiled, check_blur_tiled, &problem, 0., bytes);
+      bench_run(&bench);
+      if (bench.format == BENCH_TEXT)
+         printf("Speedup of tiled: %.2f\n", bench.variants[0].stats.median / bench.variants[1].stats.median);
+      free_pic(pic, size, size);
+      free_pic(naive, size, size);
+      free_pic(tiled, size, size);
+   }
+}
+
 int main(int argc, char** argv)
 {
    size_t rows,cols;
    unsigned int check;
 
+   // Benchmark mode: ./blur_solution bench [max_size] [csv|json] [warmup=N] [reps=N]
+   if (argc >= 2 && strcmp(argv[1], "bench") == 0)
+   {
+       int has_size = argc >= 3 && argv[2][0] >= '0' && argv[2][0] <= '9';
+       benchmark(has_size ? (size_t) strtol(argv[2], NULL, 10) : 32768, argc-2-has_size, argv+2+has_size);
+       return 0;
+   }
+
+   // Streaming mode: ./blur_solution stream in.rgb out.rgb rows cols
+   if (argc >= 6 && strcmp(argv[1], "stream") == 0)
+   {
+       rows = (size_t) strtol(argv[4], NULL, 10);
+       cols = (size_t) strtol(argv[5], NULL, 10);
+       if (rows < 5 || cols < 5)
+       {
+           printf("The picture must be at least 5 x 5\n");
+           return 1;
+       }
+       printf("Size of picture is %zu x %zu\n", rows, cols);
+       return blur_stream(argv[2], argv[3], rows, cols);
+   }
+
+   // Memory mapped mode: ./blur_solution mmap in.rgb out.rgb rows cols [tiled]
+   if (argc >= 6 && strcmp(argv[1], "mmap") == 0)
+   {
+       rows = (size_t) strtol(argv[4], NULL, 10);
+       cols = (size_t) strtol(argv[5], NULL, 10);
+       if (rows < 5 || cols < 5)
+       {
+           printf("The picture must be at least 5 x 5\n");
+           return 1;
+       }
+       printf("Size of picture is %zu x %zu\n", rows, cols);
+       return blur_mapped(argv[2], argv[3], rows, cols, argc >= 7 && strcmp(argv[6], "tiled") == 0);
+   }
+
    // Get the size of the picture
    // Default to 4000x 4000
+   // A third argument "tiled" selects the tiled host version of the filter
+   int tiled = argc >= 4 && strcmp(argv[3], "tiled") == 0;
    if (argc >= 3)
    {
        rows = (size_t) strtol(argv[1], NULL, 10);
@@ -148,12 +641,21 @@ int main(int argc, char** argv)
 #pragma acc update self(pic[0:rows*3*cols]) async(1)
 
    // Apply the blurring filter
-   blur(pic, blurred_pic, rows, cols);
+   // The tiled version computes the checksum while it blurs the picture
+   if (tiled)
+   {
+#pragma acc wait(1)
+       check = blur_tiled_checksum(pic, blurred_pic, rows, cols);
+   }
+   else
+   {
+       blur(pic, blurred_pic, rows, cols);
 
-   // Perform the checksum on the blurred picture
-   check = checksum(blurred_pic, rows, cols);
+       // Perform the checksum on the blurred picture
+       check = checksum(blurred_pic, rows, cols);
 
 #pragma acc update self(blurred_pic[:rows*3*cols]) wait(2) 
+   }
    // Output a picture if we have a reasonable size
    if (cols*rows <= 16e6)
    {
@@ -2,80 +2,52 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "mmap_io.h"
+#include "filters.h"
 /**
  * Apply a Sobel edge detection filter to a picture generated on the fly
+ * or mapped from a .rgb file (see mmap_io.h)
  *
  * List of functions:
- *   - void edge(unsigned char* pic,  unsigned char* blurred, size_t rows, size_t cols)
- *     the actual filter
+ *   - void edge(const unsigned char* pic,  unsigned char* edgy, size_t rows, size_t cols)
+ *     the actual filter, generated by stencil.h
  *   - void fill(unsigned char* pic, size_t rows, size_t cols)
  *     generate the original picture
  *   - void out_pic(unsigned char* pic, char* name, size_t rows, size_t cols)
  *     create a .rgb file 
  */
 
-void edge(unsigned char* pic,  unsigned char* edgy, size_t rows, size_t cols)
-{
-    /**
-     * Perform the edge detection
-     * @ param pic(in): a pointer to the original picture
-     * @ param blurred(out): a pointer to the blurred picture
-     */
-   size_t i, j, l, i_c, j_c;
-   int kernel_size = 5;
-   int pix;
-
-   char coefs[kernel_size][kernel_size] = { {-2, -1,  0,  1, 2},
-                                            {-2, -1,  0,  1, 2},
-                                            {-4, -2,  0,  2, 4},
-                                            {-2, -1,  0,  1, 2},
-                                            {-2, -1,  0,  1, 2}};
-   for (i=2; i<rows-2; ++i)
-      for (j=2; j<cols-2; ++j)
-         for (l=0; l<3; ++l)
-         {
-            pix = 0;
-            for (i_c=0; i_c<3; ++i_c)
-                for (j_c=0; j_c<3; ++j_c)
-                   pix += (pic[(i+i_c-2)*3*cols+(j+j_c-2)*3+l]
-                           *coefsT[i_c][j_c]);
-             if (pix < 0) pix = 0; 
-             edgy[i*3*cols+j*3+l] = (unsigned char)(pix/256);
-         }
-}
+#define STENCIL_NAME edge
+#define STENCIL_TYPE unsigned char
+#define STENCIL_RADIUS EDGE_RADIUS
+#define STENCIL_CHANNELS 3
+#define STENCIL_COEFS EDGE_COEFS
+#define STENCIL_FINALIZE(pix, center) EDGE_FINALIZE(pix)
+#define STENCIL_HOST
+#include "stencil.h"
 
 void fill(unsigned char* pic, size_t rows, size_t cols)
 {
     /**
-     * Fill the picture with data
+     * Fill the picture with data: a bright disk on a background
+     * with an horizontal gradient
      * @param pic(out): a pointer to the picture
      * @param rows(in) the number of rows in the picture
      * @param cols(in) the number of columns in the picture
      *
      */
 
-    size_t i, j;
-    double val = 0.;
-    double l = 0.5;
-    double h = 0.3;
-    for (i=0; i < rows/2; ++i)
-    {
-        double x[4] = {(l+sqrt(d)*.5)*3.*cols, (l-sqrt(d)*.5)*3.*cols, -(l+sqrt(d)*.5)*3.*cols, -(l-sqrt(d)*.5)*3.*cols};
-        double y = (double) (3*cols - i) / (3.*cols);
-        double d = h-y;
-        for (j=0; j < 3*cols; ++j)
+    size_t i, j, l;
+    double r = 0.3;
+    for (i=0; i < rows; ++i)
+        for (j=0; j < cols; ++j)
         {
-            for (int k=0; k<4; ++k)
-                val = 1.0/(1.0+x[i]*x[i])+1.0;
+            double x = (double) j / cols - 0.5;
+            double y = (double) i / rows - 0.5;
+            int inside = x*x + y*y < r*r;
+            for (l=0; l < 3; ++l)
+                pic[i*3*cols+j*3+l] = inside ? 255 : (unsigned char) (64*l*(x+0.5));
         }
-            pic[i*3*cols+j] = (unsigned char) (val*256);
-    }
-}
-
-void read(unsigned char* path, unsigned char* pic, size_t rows, size_t cols)
-{
-    FILE* f = fopen(*path, "rb");
-    fread(pic, sizeof(unsigned char), rows*3*cols, f);
 }
 
 void out_pic(unsigned char* pic, char* name, size_t rows, size_t cols)
@@ -91,28 +63,52 @@ void out_pic(unsigned char* pic, char* name, size_t rows, size_t cols)
    fclose(f);
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
    size_t rows,cols;
 
-   rows = 4000;
-   cols = 4000;
+   // Usage: ./edge_simple_exercise [rows cols [in.rgb out.rgb]]
+   // With two paths the pictures are mapped in memory instead of generated
+   if (argc >= 3)
+   {
+       rows = (size_t) strtol(argv[1], NULL, 10);
+       cols = (size_t) strtol(argv[2], NULL, 10);
+   } else
+   {
+       rows = 4000;
+       cols = 4000;
+   }
+
+   printf("Size of picture is %zu x %zu\n", rows, cols); 
+   if (argc >= 5)
+   {
+       unsigned char* pic = map_input(argv[3], rows*3*cols);
+       unsigned char* edge_pic = pic != NULL ? map_output(argv[4], rows*3*cols) : NULL;
+       if (edge_pic == NULL)
+       {
+           unmap(pic, rows*3*cols);
+           return 1;
+       }
+       edge(pic, edge_pic, rows, cols);
+       unmap(pic, rows*3*cols);
+       unmap(edge_pic, rows*3*cols);
+       return 0;
+   }
 
-   printf("Size of picture is %d x %d\n", rows, cols); 
    unsigned char* pic = (unsigned char*) malloc(rows*3*cols*sizeof(unsigned char));
-   unsigned char* blurred_pic = (unsigned char*) malloc(rows*3*cols*sizeof(unsigned char));
+   unsigned char* edge_pic = (unsigned char*) calloc(rows*3*cols, sizeof(unsigned char));
 
    // Create the original picture
    fill(pic, rows, cols);
 
-   // Apply the blurring filter
-   blur(pic, blurred_pic, rows, cols);
+   // Apply the edge detection filter
+   edge(pic, edge_pic, rows, cols);
 
    out_pic(pic, "pic.rgb", rows, cols);
-   out_pic(blurred_pic, "blurred.rgb", rows, cols);
+   out_pic(edge_pic, "edge.rgb", rows, cols);
 
    free(pic);
-   free(blurred_pic);
+   free(edge_pic);
 
    return 0;
 }
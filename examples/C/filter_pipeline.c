@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mmap_io.h"
+#include "filters.h"
+/**
+ * Apply the blur, the edge detection and a threshold to a .rgb picture
+ *
+ * Usage: ./filter_pipeline in.rgb out.rgb rows cols [threshold] [fused|separate|check]
+ *   - fused: the three filters are applied band by band. Only the blurred rows
+ *     needed by the edge detection are kept and the threshold is applied when
+ *     the edge detection produces a pixel.
+ *   - separate: the filters are applied one after the other on full pictures
+ *     as blur_solution and edge_simple_exercise do.
+ *   - check: run both versions and compare the results.
+ * The input can be created with blur_solution (pic.rgb). This example runs on the host.
+ *
+ * List of functions:
+ *   - void pipeline_separate(const unsigned char* pic, unsigned char* out, size_t rows, size_t cols)
+ *     the reference version
+ *   - void pipeline_fused(const unsigned char* pic, unsigned char* out, size_t rows, size_t cols)
+ *     the fused version
+ */
+
+// Number of rows produced by each band of the fused version
+#ifndef BAND_ROWS
+#define BAND_ROWS 64
+#endif
+#define MIN(a,b) ( ((a)<(b))?(a):(b) )
+#define MAX(a,b) ( ((a)>(b))?(a):(b) )
+
+// Threshold applied to the result of the edge detection
+unsigned char threshold = 4;
+
+#define STENCIL_NAME blur_stencil
+#define STENCIL_TYPE unsigned char
+#define STENCIL_RADIUS BLUR_RADIUS
+#define STENCIL_CHANNELS 1
+#define STENCIL_COEFS BLUR_COEFS
+#define STENCIL_FINALIZE(pix, center) BLUR_FINALIZE(pix)
+#define STENCIL_HOST
+#include "stencil.h"
+
+#define STENCIL_NAME edge
+#define STENCIL_TYPE unsigned char
+#define STENCIL_RADIUS EDGE_RADIUS
+#define STENCIL_CHANNELS 3
+#define STENCIL_COEFS EDGE_COEFS
+#define STENCIL_FINALIZE(pix, center) EDGE_FINALIZE(pix)
+#define STENCIL_HOST
+#include "stencil.h"
+
+// Edge detection followed by the threshold
+#define STENCIL_NAME edge_threshold
+#define STENCIL_TYPE unsigned char
+#define STENCIL_RADIUS EDGE_RADIUS
+#define STENCIL_CHANNELS 3
+#define STENCIL_COEFS EDGE_COEFS
+#define STENCIL_FINALIZE(pix, center) THRESHOLD(EDGE_FINALIZE(pix), threshold)
+#define STENCIL_HOST
+#include "stencil.h"
+
+void pipeline_separate(const unsigned char* pic, unsigned char* out, size_t rows, size_t cols)
+{
+    /**
+     * Apply the filters one after the other on full pictures
+     * The border of the intermediate pictures is black
+     * @param pic(in): a pointer to the original picture
+     * @param out(out): a pointer to the final picture
+     * @param rows(in) the number of rows in the picture
+     * @param cols(in) the number of columns in the picture
+     */
+   size_t size = rows*3*cols;
+   unsigned char* blurred = (unsigned char*) calloc(size, sizeof(unsigned char));
+   unsigned char* edgy = (unsigned char*) calloc(size, sizeof(unsigned char));
+
+   blur_stencil_rows(pic, blurred, 2, rows-2, 6, 3*cols-6, 3*cols);
+   edge(blurred, edgy, rows, cols);
+#pragma omp parallel for schedule(static)
+   for (size_t i=0; i < size; ++i)
+      out[i] = THRESHOLD(edgy[i], threshold);
+
+   free(blurred);
+   free(edgy);
+}
+
+void pipeline_fused(const unsigned char* pic, unsigned char* out, size_t rows, size_t cols)
+{
+    /**
+     * Apply the filters band by band
+     * The band buffer holds the blurred rows [k0-2, k1+2[ needed to compute
+     * the rows [k0, k1[ of the result. The last 4 rows are moved to the top
+     * of the buffer for the next band.
+     * @param pic(in): a pointer to the original picture
+     * @param out(out): a pointer to the final picture
+     * @param rows(in) the number of rows in the picture
+     * @param cols(in) the number of columns in the picture
+     */
+   const size_t stride = 3*cols;
+   const unsigned char border = THRESHOLD(0, threshold);
+   // The bytes of the border of the blurred rows stay black
+   unsigned char* band = (unsigned char*) calloc((BAND_ROWS+4)*stride, sizeof(unsigned char));
+   // Number of blurred rows at the top of the band kept from the previous band
+   size_t kept = 0;
+
+   memset(out, border, 2*stride);
+   memset(out+(rows-2)*stride, border, 2*stride);
+   for (size_t k0=2; k0 < rows-2; k0 += BAND_ROWS)
+   {
+      size_t k1 = MIN(k0+BAND_ROWS, rows-2);
+      size_t base = k0-2;
+      // Blur the missing rows [b0, b1[, the last 2 rows of the picture are black
+      size_t b0 = base+kept;
+      size_t b1 = k1+2;
+      blur_stencil_rows(pic+base*stride, band, MAX(b0, 2)-base, MIN(b1, rows-2)-base,
+                        6, stride-6, stride);
+      for (size_t r=MAX(b0, rows-2); r < b1; ++r)
+         memset(band+(r-base)*stride, 0, stride);
+
+      edge_threshold_rows(band, out+base*stride, 2, 2+k1-k0, 2, cols-2, cols);
+      for (size_t i=k0; i < k1; ++i)
+      {
+         memset(out+i*stride, border, 6);
+         memset(out+i*stride+stride-6, border, 6);
+      }
+
+      memmove(band, band+(k1-k0)*stride, 4*stride);
+      kept = 4;
+   }
+   free(band);
+}
+
+double run(void (*pipeline)(const unsigned char*, unsigned char*, size_t, size_t),
+           const unsigned char* pic, unsigned char* out, size_t rows, size_t cols)
+{
+    /**
+     * Run a version of the pipeline and return the elapsed time in seconds
+     */
+   struct timespec end, start;
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+   pipeline(pic, out, rows, cols);
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+   return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.e9;
+}
+
+int main(int argc, char** argv)
+{
+   if (argc < 5)
+   {
+       printf("Usage: %s in.rgb out.rgb rows cols [threshold] [fused|separate|check]\n", argv[0]);
+       return 1;
+   }
+   size_t rows = (size_t) strtol(argv[3], NULL, 10);
+   size_t cols = (size_t) strtol(argv[4], NULL, 10);
+   if (argc >= 6)
+       threshold = (unsigned char) strtol(argv[5], NULL, 10);
+   const char* mode = argc >= 7 ? argv[6] : "fused";
+   if (rows < 5 || cols < 5)
+   {
+       printf("The picture must be at least 5 x 5\n");
+       return 1;
+   }
+   size_t size = rows*3*cols;
+   printf("Size of picture is %zu x %zu, threshold %d\n", rows, cols, threshold);
+
+   unsigned char* pic = map_input(argv[1], size);
+   unsigned char* out = pic != NULL ? map_output(argv[2], size) : NULL;
+   if (out == NULL)
+   {
+       unmap(pic, size);
+       return 1;
+   }
+
+   int status = 0;
+   if (strcmp(mode, "separate") == 0)
+   {
+       double t = run(pipeline_separate, pic, out, rows, cols);
+       printf("Separate filters: %10.5e s, intermediate pictures %10.3f MB\n", t, 2.*size/1.e6);
+   }
+   else
+   {
+       double t = run(pipeline_fused, pic, out, rows, cols);
+       printf("Fused filters:    %10.5e s, intermediate band    %10.3f MB\n", t, (BAND_ROWS+4.)*3*cols/1.e6);
+       if (strcmp(mode, "check") == 0)
+       {
+           unsigned char* ref = (unsigned char*) malloc(size*sizeof(unsigned char));
+           t = run(pipeline_separate, pic, ref, rows, cols);
+           printf("Separate filters: %10.5e s, intermediate pictures %10.3f MB\n", t, 2.*size/1.e6);
+           status = memcmp(ref, out, size) != 0;
+           printf("The results are %s\n", status ? "DIFFERENT" : "identical");
+           free(ref);
+       }
+   }
+
+   unmap(pic, size);
+   unmap(out, size);
+   return status;
+}
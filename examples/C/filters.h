@@ -0,0 +1,30 @@
+#ifndef FILTERS_H
+#define FILTERS_H
+/**
+ * Definition of the filters applied to the .rgb pictures
+ * Each filter is a set of coefficients and the conversion of the weighted
+ * sum into a pixel. They are used to instantiate stencil.h.
+ */
+
+// 5x5 gaussian kernel. The horizontal neighbours of an element are the
+// neighbouring bytes of the interleaved RGB picture (1 channel, 3*cols columns).
+#define BLUR_RADIUS 2
+#define BLUR_COEFS { {1,  4,  6,  4,  1}, \
+                     {4, 16, 24, 16,  4}, \
+                     {6, 24, 36, 24,  6}, \
+                     {4, 16, 24, 16,  4}, \
+                     {1,  4,  6,  4,  1}}
+#define BLUR_FINALIZE(pix) ((unsigned char) ((pix)/256))
+
+// Horizontal gradient (3 channels). Negative values are set to 0
+#define EDGE_RADIUS 2
+#define EDGE_COEFS { {-2, -1,  0,  1, 2}, \
+                     {-2, -1,  0,  1, 2}, \
+                     {-4, -2,  0,  2, 4}, \
+                     {-2, -1,  0,  1, 2}, \
+                     {-2, -1,  0,  1, 2}}
+#define EDGE_FINALIZE(pix) ((unsigned char) ((pix) < 0 ? 0 : (pix)/256))
+
+// Binary picture: 255 if the value is at least the threshold, 0 otherwise
+#define THRESHOLD(val, threshold) ((unsigned char) ((val) >= (threshold) ? 255 : 0))
+#endif
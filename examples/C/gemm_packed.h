@@ -0,0 +1,218 @@
+#ifndef GEMM_PACKED_H
+#define GEMM_PACKED_H
+/**
+ * Matrix product with packed panels (GotoBLAS) on the host
+ *
+ * d = d + a*b for row major matrices: a is ni x nk, b is nk x nj, d is ni x nj.
+ * The loops are blocked for the caches:
+ *   - a panel of KC rows and NC columns of b is copied (packed) in slivers of
+ *     NR columns, each sliver being KC x NR contiguous elements. The panel is
+ *     read from the L3 cache and one sliver stays in the L1 cache.
+ *   - a block of MC rows and KC columns of a is packed in slivers of MR rows
+ *     (KC x MR contiguous elements) which stay in the L2 cache.
+ *   - the micro-kernel computes MR x NR elements of d in vector registers
+ *     from one sliver of a and one sliver of b: KC updates of rank 1 with
+ *     one broadcast of a and NR/lanes FMA per row.
+ * The slivers are padded with zeros, so the micro-kernel always computes a
+ * full MR x NR block. The vector micro-kernels add the full blocks to d
+ * straight from the registers: only the blocks on the edges of d go through
+ * a buffer (the portable micro-kernel accumulates in the buffer).
+ * The blocks of a are shared out between the OpenMP threads.
+ *
+ * List of functions:
+ *   - void gemm_packed(int ni, int nj, int nk, const double* a, const double* b, double* d)
+ */
+#include <stdlib.h>
+#include <string.h>
+#if (defined(__AVX512F__) || defined(__AVX2__)) && defined(__x86_64__)
+   #include <immintrin.h>
+#endif
+
+// Size of the micro-kernel: MR rows of NR elements in registers
+#if defined(__AVX512F__) && defined(__x86_64__)
+  #define GEMM_MR 12
+  #define GEMM_NR 16
+#elif defined(__AVX2__) && defined(__FMA__) && defined(__x86_64__)
+  #define GEMM_MR 6
+  #define GEMM_NR 8
+#else
+  #define GEMM_MR 4
+  #define GEMM_NR 8
+#endif
+// Blocking for the caches (MC multiple of MR, NC multiple of NR)
+#ifndef GEMM_KC
+#define GEMM_KC 256
+#endif
+#ifndef GEMM_MC
+#define GEMM_MC 384
+#endif
+#ifndef GEMM_NC
+#define GEMM_NC 4096
+#endif
+// The packed buffers hold GEMM_MC x GEMM_KC and GEMM_KC x GEMM_NC elements,
+// the slivers being padded to GEMM_MR rows and GEMM_NR columns
+#if GEMM_MC % GEMM_MR || GEMM_NC % GEMM_NR
+#error "GEMM_MC must be a multiple of GEMM_MR and GEMM_NC a multiple of GEMM_NR"
+#endif
+
+void gemm_pack_a(int mc, int kc, const double* restrict a, int lda, double* restrict packed)
+{
+    /**
+     * Pack a block of a in slivers of GEMM_MR rows, column after column
+     * @param mc, kc: the size of the block
+     * @param a: a pointer to the first element of the block
+     * @param lda: the number of columns of a
+     */
+    for (int s=0; s < mc; s+=GEMM_MR)
+        for (int p=0; p < kc; ++p)
+            for (int r=0; r < GEMM_MR; ++r)
+                *packed++ = s+r < mc ? a[(size_t) (s+r)*lda + p] : 0.;
+}
+
+void gemm_pack_b(int kc, int nr, const double* restrict b, int ldb, double* restrict packed)
+{
+    /**
+     * Pack a sliver of b of up to GEMM_NR columns, row after row
+     * @param kc, nr: the size of the sliver
+     * @param b: a pointer to the first element of the sliver
+     * @param ldb: the number of columns of b
+     */
+    for (int p=0; p < kc; ++p)
+        for (int r=0; r < GEMM_NR; ++r)
+            *packed++ = r < nr ? b[(size_t) p*ldb + r] : 0.;
+}
+
+void gemm_micro_kernel(int kc, const double* restrict a, const double* restrict b, double* restrict d, int ldd,
+                       int mr, int nr)
+{
+    /**
+     * d = d + a*b for a block of GEMM_MR x GEMM_NR elements
+     * @param kc: the number of updates
+     * @param a, b: the packed slivers
+     * @param d: a pointer to the first element of the block
+     * @param ldd: the number of columns of d
+     * @param mr, nr: the part of the block inside d
+     */
+    double block[GEMM_MR*GEMM_NR] __attribute__((aligned(64)));
+#if defined(__AVX512F__) && defined(__x86_64__)
+    __m512d c0[GEMM_MR], c1[GEMM_MR];
+    for (int r=0; r < GEMM_MR; ++r)
+    {
+        c0[r] = _mm512_setzero_pd();
+        c1[r] = _mm512_setzero_pd();
+    }
+    for (int p=0; p < kc; ++p)
+    {
+        const __m512d b0 = _mm512_load_pd(b + p*GEMM_NR);
+        const __m512d b1 = _mm512_load_pd(b + p*GEMM_NR + 8);
+        for (int r=0; r < GEMM_MR; ++r)
+        {
+            const __m512d x = _mm512_set1_pd(a[p*GEMM_MR + r]);
+            c0[r] = _mm512_fmadd_pd(x, b0, c0[r]);
+            c1[r] = _mm512_fmadd_pd(x, b1, c1[r]);
+        }
+    }
+    // Full block: added to d from the registers
+    if (mr == GEMM_MR && nr == GEMM_NR)
+    {
+        for (int r=0; r < GEMM_MR; ++r)
+        {
+            double* row = d + (size_t) r*ldd;
+            _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), c0[r]));
+            _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), c1[r]));
+        }
+        return;
+    }
+    for (int r=0; r < GEMM_MR; ++r)
+    {
+        _mm512_store_pd(block + r*GEMM_NR, c0[r]);
+        _mm512_store_pd(block + r*GEMM_NR + 8, c1[r]);
+    }
+#elif defined(__AVX2__) && defined(__FMA__) && defined(__x86_64__)
+    __m256d c0[GEMM_MR], c1[GEMM_MR];
+    for (int r=0; r < GEMM_MR; ++r)
+    {
+        c0[r] = _mm256_setzero_pd();
+        c1[r] = _mm256_setzero_pd();
+    }
+    for (int p=0; p < kc; ++p)
+    {
+        const __m256d b0 = _mm256_load_pd(b + p*GEMM_NR);
+        const __m256d b1 = _mm256_load_pd(b + p*GEMM_NR + 4);
+        for (int r=0; r < GEMM_MR; ++r)
+        {
+            const __m256d x = _mm256_broadcast_sd(a + p*GEMM_MR + r);
+            c0[r] = _mm256_fmadd_pd(x, b0, c0[r]);
+            c1[r] = _mm256_fmadd_pd(x, b1, c1[r]);
+        }
+    }
+    // Full block: added to d from the registers
+    if (mr == GEMM_MR && nr == GEMM_NR)
+    {
+        for (int r=0; r < GEMM_MR; ++r)
+        {
+            double* row = d + (size_t) r*ldd;
+            _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), c0[r]));
+            _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), c1[r]));
+        }
+        return;
+    }
+    for (int r=0; r < GEMM_MR; ++r)
+    {
+        _mm256_store_pd(block + r*GEMM_NR, c0[r]);
+        _mm256_store_pd(block + r*GEMM_NR + 4, c1[r]);
+    }
+#else
+    memset(block, 0, sizeof(block));
+    for (int p=0; p < kc; ++p)
+        for (int r=0; r < GEMM_MR; ++r)
+#pragma omp simd
+            for (int j=0; j < GEMM_NR; ++j)
+                block[r*GEMM_NR + j] += a[p*GEMM_MR + r] * b[p*GEMM_NR + j];
+#endif
+    for (int r=0; r < mr; ++r)
+#pragma omp simd
+        for (int j=0; j < nr; ++j)
+            d[(size_t) r*ldd + j] += block[r*GEMM_NR + j];
+}
+
+void gemm_packed(int ni, int nj, int nk, const double* restrict a, const double* restrict b, double* restrict d)
+{
+    /**
+     * d = d + a*b
+     * @param ni, nj, nk: d is ni x nj, a is ni x nk and b is nk x nj
+     */
+    double* packed_b = (double*) aligned_alloc(64, (size_t) GEMM_KC*GEMM_NC*sizeof(double));
+#pragma omp parallel
+{
+    double* packed_a = (double*) aligned_alloc(64, (size_t) GEMM_MC*GEMM_KC*sizeof(double));
+    for (int jc=0; jc < nj; jc+=GEMM_NC)
+    {
+        const int nc = nj-jc < GEMM_NC ? nj-jc : GEMM_NC;
+        for (int pc=0; pc < nk; pc+=GEMM_KC)
+        {
+            const int kc = nk-pc < GEMM_KC ? nk-pc : GEMM_KC;
+#pragma omp for schedule(static)
+            for (int jr=0; jr < nc; jr+=GEMM_NR)
+                gemm_pack_b(kc, nc-jr < GEMM_NR ? nc-jr : GEMM_NR, b + (size_t) pc*nj + jc+jr, nj,
+                            packed_b + (size_t) jr*kc);
+#pragma omp for schedule(dynamic)
+            for (int ic=0; ic < ni; ic+=GEMM_MC)
+            {
+                const int mc = ni-ic < GEMM_MC ? ni-ic : GEMM_MC;
+                gemm_pack_a(mc, kc, a + (size_t) ic*nk + pc, nk, packed_a);
+                // The sliver of b stays in the L1 cache for all the slivers of a
+                for (int jr=0; jr < nc; jr+=GEMM_NR)
+                    for (int ir=0; ir < mc; ir+=GEMM_MR)
+                        gemm_micro_kernel(kc, packed_a + (size_t) ir*kc, packed_b + (size_t) jr*kc,
+                                          d + (size_t) (ic+ir)*nj + jc+jr, nj,
+                                          mc-ir < GEMM_MR ? mc-ir : GEMM_MR, nc-jr < GEMM_NR ? nc-jr : GEMM_NR);
+            }
+        }
+    }
+    free(packed_a);
+}
+    free(packed_b);
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef LIFE_RANDOM_H
+#define LIFE_RANDOM_H
+/**
+ * Random initial state of the Game of Life, drawn row by row
+ *
+ * Each row of the world has its own generator, seeded from the index of the
+ * row: a process which owns a block of rows draws only the cells of its rows,
+ * and every program (serial, bit-packed, Hashlife, MPI) gets the same initial
+ * state whatever the decomposition of the world.
+ *
+ * List of functions:
+ *   - uint64_t row_generator(int row)
+ *     state of the generator of a row
+ *   - int random_cell(uint64_t* state)
+ *     next cell of the row: alive with a probability 1/4
+ */
+#include <stdint.h>
+
+static inline uint64_t row_generator(int row)
+{
+    /**
+     * Seed the generator of a row (splitmix64 of the index)
+     * @param row(in): the index of the row in the world, from 0, without the border
+     * @return the state of the generator, never 0
+     */
+    uint64_t z = (uint64_t) row + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z != 0 ? z : 1;
+}
+
+static inline int random_cell(uint64_t* state)
+{
+    /**
+     * Draw the next cell of a row (xorshift64*)
+     * @param state(inout): the state of the generator of the row
+     * @return 1 for a living cell (one chance out of 4), 0 otherwise
+     */
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    // The high bits of the product are the best distributed
+    return ((x * 0x2545F4914F6CDD1Dull) >> 62) == 0;
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #ifdef _OPENACC
   #include <openacc.h>
@@ -7,35 +8,402 @@
 #include <complex.h>
 #include <mpi.h>
 #include "../../examples/C/init_openacc.h"
-void output(unsigned char* picture, unsigned int start, unsigned int num_elements)
+// Number of rows of the tiles handed out to the workers
+#ifndef TILE_ROWS
+#define TILE_ROWS 16
+#endif
+// Messages of the master/worker protocol
+#define TAG_REQUEST 1
+#define TAG_TILE 2
+
+// Ways to write the picture
+enum { IO_INDEPENDENT, IO_COLLECTIVE, IO_COMPRESSED };
+
+MPI_File open_output(const char* path)
 {
    MPI_File     fh;
-   MPI_Offset   woffset=start;
 
-   if (MPI_File_open(MPI_COMM_WORLD,"mandel.gray",MPI_MODE_WRONLY+MPI_MODE_CREATE,MPI_INFO_NULL,&fh) != MPI_SUCCESS)
+   if (MPI_File_open(MPI_COMM_WORLD,path,MPI_MODE_WRONLY+MPI_MODE_CREATE,MPI_INFO_NULL,&fh) != MPI_SUCCESS)
    {
         fprintf(stderr,"ERROR in creating output file\n");
         MPI_Abort(MPI_COMM_WORLD,1);
    }
+   // A smaller picture or a compressed file replaces the whole previous file
+   MPI_File_set_size(fh, 0);
+   return fh;
+}
 
-   MPI_File_write_at(fh,woffset,picture,num_elements,MPI_UNSIGNED_CHAR,MPI_STATUS_IGNORE);
+void output(MPI_File fh, unsigned char* picture, unsigned int start, unsigned int num_elements)
+{
+   MPI_Offset   woffset=start;
 
-   MPI_File_close(&fh);
+   MPI_File_write_at(fh,woffset,picture,num_elements,MPI_UNSIGNED_CHAR,MPI_STATUS_IGNORE);
 } 
 
+void output_collective(MPI_File fh, unsigned char* picture, const unsigned int* first, const unsigned int* rows,
+                       int segments, unsigned int width, unsigned int height)
+{
+    /**
+     * Write all the rows of the process with one collective call
+     * The file view of the process is the subarray of its block of rows, or
+     * the list of its tiles, so that the MPI library can gather the pieces
+     * of the processes in large contiguous writes.
+     * @param picture: the rows of the segments one after the other
+     * @param first, rows: the first row and the number of rows of each segment
+     * @param segments: the number of segments (0 for the master)
+     */
+    MPI_Datatype row, view;
+    MPI_Type_contiguous((int) width, MPI_UNSIGNED_CHAR, &row);
+    MPI_Type_commit(&row);
+    int count = 0;
+    for (int k=0; k < segments; ++k)
+        count += (int) rows[k];
+    if (segments == 1)
+    {
+        int sizes[2] = {(int) height, (int) width};
+        int subsizes[2] = {(int) rows[0], (int) width};
+        int starts[2] = {(int) first[0], 0};
+        MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_UNSIGNED_CHAR, &view);
+    }
+    else
+    {
+        int* lengths = (int*) malloc((segments+1)*sizeof(int));
+        int* displacements = (int*) malloc((segments+1)*sizeof(int));
+        for (int k=0; k < segments; ++k)
+        {
+            lengths[k] = (int) rows[k];
+            displacements[k] = (int) first[k];
+        }
+        MPI_Type_indexed(segments, lengths, displacements, row, &view);
+        free(lengths);
+        free(displacements);
+    }
+    MPI_Type_commit(&view);
+    MPI_File_set_view(fh, 0, MPI_UNSIGNED_CHAR, view, "native", MPI_INFO_NULL);
+    MPI_File_write_at_all(fh, 0, picture, count, row, MPI_STATUS_IGNORE);
+    MPI_Type_free(&view);
+    MPI_Type_free(&row);
+}
+
+size_t compress(const unsigned char* in, size_t size, unsigned char* out)
+{
+    /**
+     * Run-length encoding (PackBits)
+     * A control byte n < 128 is followed by n+1 bytes to copy, a control
+     * byte n > 128 by one byte repeated 257-n times.
+     * @param out: at least size + size/128 + 1 bytes
+     * @return the size of the encoded data
+     */
+    size_t o = 0;
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t run = 1;
+        while (i+run < size && run < 128 && in[i+run] == in[i])
+            ++run;
+        if (run >= 3)
+        {
+            out[o++] = (unsigned char) (257 - run);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+        // Literal bytes up to the next run of 3 equal bytes
+        size_t literal = 0;
+        while (i+literal < size && literal < 128 &&
+               !(i+literal+2 < size && in[i+literal] == in[i+literal+1] && in[i+literal] == in[i+literal+2]))
+            ++literal;
+        out[o++] = (unsigned char) (literal - 1);
+        memcpy(out+o, in+i, literal);
+        o += literal;
+        i += literal;
+    }
+    return o;
+}
+
+size_t decompress(const unsigned char* in, size_t size, unsigned char* out)
+{
+    /**
+     * Decode the output of compress
+     * @return the size of the decoded data
+     */
+    size_t o = 0;
+    size_t i = 0;
+    while (i < size)
+    {
+        unsigned int n = in[i++];
+        if (n < 128)
+        {
+            memcpy(out+o, in+i, n+1);
+            o += n+1;
+            i += n+1;
+        }
+        else if (n > 128)
+        {
+            memset(out+o, in[i++], 257-n);
+            o += 257-n;
+        }
+    }
+    return o;
+}
+
+// Header of the compressed file, followed by the index of the segments
+#define RLE_HEADER "MANDEL-RLE %10u %10u %10d\n"
+
+int compare_segments(const void* a, const void* b)
+{
+    const unsigned long long* x = *(const unsigned long long* const*) a;
+    const unsigned long long* y = *(const unsigned long long* const*) b;
+    return (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+void output_compressed(MPI_File fh, const unsigned char* picture, const unsigned int* first,
+                       const unsigned int* rows, int segments, unsigned int width, unsigned int height)
+{
+    /**
+     * Write the segments of the process compressed, with an index
+     * The file is the header RLE_HEADER (width, height, number of segments),
+     * the index: 4 unsigned 64-bit integers per segment in the order of the
+     * rows (first row, number of rows, offset in the file, size), then the
+     * compressed segments in the same order. Each segment can be decoded
+     * alone.
+     * @param picture: the rows of the segments one after the other
+     * @param first, rows: the first row and the number of rows of each segment
+     * @param segments: the number of segments (0 for the master)
+     */
+    int rank, nb_procs;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nb_procs);
+
+    size_t pixels = 0;
+    for (int k=0; k < segments; ++k)
+        pixels += (size_t) rows[k]*width;
+    unsigned char* data = (unsigned char*) malloc(pixels + pixels/128 + segments + 1);
+    unsigned long long* local = (unsigned long long*) malloc((4*segments+1)*sizeof(unsigned long long));
+    size_t in = 0, size = 0;
+    for (int k=0; k < segments; ++k)
+    {
+        local[4*k] = first[k];
+        local[4*k+1] = rows[k];
+        local[4*k+3] = compress(picture + in, (size_t) rows[k]*width, data + size);
+        in += (size_t) rows[k]*width;
+        size += local[4*k+3];
+    }
+
+    // Index of all the segments, the offsets following the order of the rows
+    int* counts = (int*) malloc(nb_procs*sizeof(int));
+    int* displacements = (int*) malloc(nb_procs*sizeof(int));
+    int count = 4*segments;
+    MPI_Allgather(&count, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+    int total = 0;
+    for (int p=0; p < nb_procs; ++p)
+    {
+        displacements[p] = total;
+        total += counts[p];
+    }
+    unsigned long long* index = (unsigned long long*) malloc((total+1)*sizeof(unsigned long long));
+    MPI_Allgatherv(local, count, MPI_UNSIGNED_LONG_LONG, index, counts, displacements, MPI_UNSIGNED_LONG_LONG,
+                   MPI_COMM_WORLD);
+    char header[64];
+    const int header_size = snprintf(header, sizeof(header), RLE_HEADER, width, height, total/4);
+    unsigned long long** order = (unsigned long long**) malloc((total/4+1)*sizeof(unsigned long long*));
+    for (int k=0; k < total/4; ++k)
+        order[k] = index + 4*k;
+    qsort(order, total/4, sizeof(unsigned long long*), compare_segments);
+    unsigned long long offset = header_size + total*sizeof(unsigned long long);
+    for (int k=0; k < total/4; ++k)
+    {
+        order[k][2] = offset;
+        offset += order[k][3];
+    }
+
+    if (rank == 0)
+    {
+        unsigned long long* sorted = (unsigned long long*) malloc((total+1)*sizeof(unsigned long long));
+        for (int k=0; k < total/4; ++k)
+            memcpy(sorted + 4*k, order[k], 4*sizeof(unsigned long long));
+        MPI_File_write_at(fh, 0, header, header_size, MPI_CHAR, MPI_STATUS_IGNORE);
+        MPI_File_write_at(fh, header_size, sorted, total, MPI_UNSIGNED_LONG_LONG, MPI_STATUS_IGNORE);
+        free(sorted);
+    }
+
+    // The compressed segments of the process are written with one collective call
+    int* lengths = (int*) malloc((segments+1)*sizeof(int));
+    MPI_Aint* offsets = (MPI_Aint*) malloc((segments+1)*sizeof(MPI_Aint));
+    for (int k=0; k < segments; ++k)
+    {
+        lengths[k] = (int) index[displacements[rank] + 4*k + 3];
+        offsets[k] = (MPI_Aint) index[displacements[rank] + 4*k + 2];
+    }
+    MPI_Datatype view;
+    MPI_Type_create_hindexed(segments, lengths, offsets, MPI_UNSIGNED_CHAR, &view);
+    MPI_Type_commit(&view);
+    MPI_File_set_view(fh, 0, MPI_UNSIGNED_CHAR, view, "native", MPI_INFO_NULL);
+    MPI_File_write_at_all(fh, 0, data, (int) size, MPI_UNSIGNED_CHAR, MPI_STATUS_IGNORE);
+    MPI_Type_free(&view);
+    if (rank == 0)
+        printf("Compressed picture: %llu bytes for %u pixels (%.1f%%)\n", offset, width*height,
+               100.*offset/((double) width*height));
+
+    free(data);
+    free(local);
+    free(counts);
+    free(displacements);
+    free(index);
+    free(order);
+    free(lengths);
+    free(offsets);
+}
+
+int uncompress_picture(const char* in, const char* out)
+{
+    /**
+     * Convert a picture written by output_compressed to the raw format
+     * @return 0 on success
+     */
+    FILE* f = fopen(in, "rb");
+    unsigned int width, height;
+    int segments;
+    if (f == NULL || fscanf(f, "MANDEL-RLE %u %u %d", &width, &height, &segments) != 3 || fgetc(f) != '\n')
+    {
+        fprintf(stderr, "ERROR in reading %s\n", in);
+        if (f != NULL)
+            fclose(f);
+        return 1;
+    }
+    unsigned long long* index = (unsigned long long*) malloc((4*segments+1)*sizeof(unsigned long long));
+    unsigned char* picture = (unsigned char*) calloc((size_t) width*height, sizeof(unsigned char));
+    int error = fread(index, sizeof(unsigned long long), 4*segments, f) != (size_t) 4*segments;
+    for (int k=0; k < segments && !error; ++k)
+    {
+        unsigned char* data = (unsigned char*) malloc(index[4*k+3]+1);
+        error = fseek(f, (long) index[4*k+2], SEEK_SET) != 0 || fread(data, 1, index[4*k+3], f) != index[4*k+3]
+                || index[4*k] + index[4*k+1] > height
+                || decompress(data, index[4*k+3], picture + index[4*k]*width) != index[4*k+1]*width;
+        free(data);
+    }
+    fclose(f);
+    if (error)
+        fprintf(stderr, "ERROR in decoding %s\n", in);
+    else
+    {
+        f = fopen(out, "wb");
+        fwrite(picture, sizeof(unsigned char), (size_t) width*height, f);
+        fclose(f);
+        printf("%s (%u x %u pixels, %d segments) converted to %s\n", in, width, height, segments, out);
+    }
+    free(index);
+    free(picture);
+    return error;
+}
+
 #pragma acc routine seq
-unsigned char mandelbrot_iterations(const float complex c)
+unsigned char mandelbrot_iterations(const float complex c, unsigned char* work)
 {
+    /**
+     * Number of iterations before the orbit of c escapes
+     * The result is the same as without the shortcuts: it is also the number
+     * of iterations the plain loop would compute.
+     * @param c: the point of the complex plane
+     * @param work(out): the number of iterations actually computed
+     */
     unsigned char max_iter = 255;
     unsigned char n = 0;
-    float complex z = 0.0 + 0.0 * I;
-    while (abs(z*z) <= 2 && n < max_iter)
+    *work = 0;
+    const float cr = crealf(c);
+    const float ci = cimagf(c);
+    // The points of the main cardioid and of the period-2 bulb are in the set
+    const float q = (cr - 0.25f)*(cr - 0.25f) + ci*ci;
+    if (q*(q + (cr - 0.25f)) <= 0.25f*ci*ci || (cr + 1.f)*(cr + 1.f) + ci*ci <= 0.0625f)
+        return max_iter;
+    float zr = 0.;
+    float zi = 0.;
+    // Points of the orbit at the iterations 2, 4, 8... (Brent): if the orbit
+    // comes back exactly to one of them, it is periodic and never escapes
+    float saved_r = 0.;
+    float saved_i = 0.;
+    int next_save = 2;
+    // |z| <= 2 is tested as |z|^2 <= 4: no square root
+    while (zr*zr + zi*zi <= 4.f && n < max_iter)
     {
-        z = z*z + c;
+        float t = zr*zr - zi*zi + cr;
+        zi = 2.f*zr*zi + ci;
+        zr = t;
         ++n;
+        if (zr == saved_r && zi == saved_i)
+        {
+            *work = n;
+            return max_iter;
+        }
+        if (n == next_save)
+        {
+            saved_r = zr;
+            saved_i = zi;
+            next_save *= 2;
+        }
     }
+    *work = n;
     return n;
 }
+
+void mandelbrot_rows(unsigned char* restrict picture, unsigned int first, unsigned int last,
+                     unsigned int width, unsigned int height, unsigned long int* counts)
+{
+    /**
+     * Compute the rows [first, last[ of the picture
+     * @param picture: a pointer to the rows [first, last[ only
+     * @param first, last: the range of rows to compute
+     * @param width, height: the size of the picture
+     * @param counts(inout): incremented by the number of iterations without
+     *                       the shortcuts (counts[0]) and computed (counts[1])
+     */
+    float step_w = 1./width;
+    float step_h = 1./height;
+
+    const float min_re = -2.;
+    const float max_re = 1.;
+    const float min_im = -1.;
+    const float max_im = 1.;
+
+    unsigned int local_height = last - first;
+    unsigned long int plain = 0, computed = 0;
+#pragma acc parallel loop copyout(picture[0:local_height*width]) reduction(+:plain, computed)
+    for (unsigned int i=0; i<local_height; ++i)
+        for (unsigned int j=0; j<width; ++j)
+        {
+            float complex c;
+            c = min_re + j*step_w * (max_re - min_re) + \
+                I * (min_im +  ((i+first) * step_h) * (max_im - min_im));
+            unsigned char work;
+            unsigned char n = mandelbrot_iterations(c, &work);
+            picture[width*i+j] = (unsigned char)255 - n;
+            plain += n;
+            computed += work;
+        }
+    counts[0] += plain;
+    counts[1] += computed;
+}
+
+void master(unsigned int tiles, int nb_procs)
+{
+    /**
+     * Hand out the tiles to the workers which ask for one
+     * A worker gets the tile number -1 when there are no more tiles.
+     */
+    int stopped = 0;
+    unsigned int next_tile = 0;
+    while (stopped < nb_procs-1)
+    {
+        int dummy;
+        MPI_Status status;
+        MPI_Recv(&dummy, 1, MPI_INT, MPI_ANY_SOURCE, TAG_REQUEST, MPI_COMM_WORLD, &status);
+        int tile = next_tile < tiles ? (int) next_tile++ : -1;
+        if (tile < 0)
+            ++stopped;
+        MPI_Send(&tile, 1, MPI_INT, status.MPI_SOURCE, TAG_TILE, MPI_COMM_WORLD);
+    }
+}
+
 int main(int argc, char** argv)
 {
     #ifdef _OPENACC
@@ -43,87 +411,183 @@ int main(int argc, char** argv)
     #endif   
     MPI_Init(&argc, &argv);
     // Dimension of the world in pixels.
-    int width, height;
+    unsigned int width, height;
     if (argc >= 3)
     {
-        unsigned int width = (unsigned int) atoi(argv[1]);
-        unsigned int height = (unsigned int) atoi(argv[2]);
+        width = (unsigned int) atoi(argv[1]);
+        height = (unsigned int) atoi(argv[2]);
     }
     else
     {
         width = 4000;
         height = 4000;
     }
-    
-    float step_w = 1./width;
-    float step_h = 1./height;
-
-    const float min_re = -2.;
-    const float max_re = 1.;
-    const float min_im = -1.;
-    const float max_im = 1.;
+    // With more than one process, rank 0 is the master handing out tiles of
+    // rows to the workers. "static" gives a fixed block of rows to each process.
+    // The picture is written with one collective call at the end, or by each
+    // process after each tile ("independent"), or compressed to mandel.rle
+    // ("compressed", converted back to mandel.gray with "uncompress").
+    int dynamic = 1;
+    int io = IO_COLLECTIVE;
+    int uncompress = 0;
+    for (int a=3; a < argc; ++a)
+    {
+        if (strcmp(argv[a], "static") == 0)
+            dynamic = 0;
+        else if (strcmp(argv[a], "independent") == 0)
+            io = IO_INDEPENDENT;
+        else if (strcmp(argv[a], "compressed") == 0)
+            io = IO_COMPRESSED;
+        else if (strcmp(argv[a], "uncompress") == 0)
+            uncompress = 1;
+    }
 
     struct timespec end, start;
     clock_gettime(CLOCK_MONOTONIC_RAW, &start);
 
-    int i;
     int rank;
     int nb_procs;
     
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &nb_procs);
 
-    unsigned int local_height = height / nb_procs;
-    unsigned int first = 0;
-    unsigned int last = local_height;
-    unsigned int rest_eucli = height % nb_procs;
-
-    if ((rank==0) && (rank < rest_eucli))
-          ++last;
-
-    for (i=1; i <= rank; ++i)
+    if (uncompress)
     {
-      first += local_height;
-      last  += local_height;
-      if (rank < rest_eucli)
-          {
-              ++first;
-              ++last;
-          }
+        int error = rank == 0 ? uncompress_picture("mandel.rle", "mandel.gray") : 0;
+        MPI_Finalize();
+        return error;
     }
-
-    if (rank < rest_eucli) 
-        ++local_height;
-
-    unsigned int num_elements = width*local_height;
-    if (rank == 0) printf("Using MPI\n");
+    const char* io_names[] = {"independent writes", "a collective write", "a compressed collective write"};
+    if (rank == 0) printf("Using MPI with %s scheduling and %s\n", dynamic ? "dynamic" : "static", io_names[io]);
     #ifdef _OPENACC
-    printf("I am rank %2d and my range is [%5d, %5d[ ie %10d elements. I use GPU %d over %d devices.\n", rank, first, last, num_elements,info.current_device, info.total_devices);
-    #else
-    printf("I am rank %2d and my range is [%5d, %5d[ ie %10d elements.", rank, first, last, num_elements);
+    printf("I am rank %2d. I use GPU %d over %d devices.\n", rank, info.current_device, info.total_devices);
     #endif
 
-    unsigned char* restrict picture = (unsigned char*) malloc(num_elements*sizeof(unsigned char));
+    MPI_File fh = open_output(io == IO_COMPRESSED ? "mandel.rle" : "mandel.gray");
+    // Time spent computing, number of tiles and of rows of the process, time spent writing
+    double stats[4] = {0., 0., 0., 0.};
+    // Iterations of the process without the shortcuts and computed
+    unsigned long int counts[2] = {0, 0};
+    // Rows computed by the process, kept for the final write: segment k has
+    // rows[k] rows from the row first[k]
+    unsigned char* restrict picture = NULL;
+    const unsigned int tiles = (height + TILE_ROWS-1) / TILE_ROWS;
+    unsigned int* first = (unsigned int*) malloc(tiles*sizeof(unsigned int));
+    unsigned int* rows = (unsigned int*) malloc(tiles*sizeof(unsigned int));
+    int segments = 0;
+    if (dynamic)
+    {
+        size_t stored = 0, capacity = TILE_ROWS;
+        picture = (unsigned char*) malloc(capacity*width*sizeof(unsigned char));
+        if (rank == 0 && nb_procs > 1)
+            master(tiles, nb_procs);
+        else
+            for (unsigned int k=0; ; ++k)
+            {
+                int tile = (int) k;
+                if (nb_procs > 1)
+                {
+                    MPI_Send(&tile, 1, MPI_INT, 0, TAG_REQUEST, MPI_COMM_WORLD);
+                    MPI_Recv(&tile, 1, MPI_INT, 0, TAG_TILE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                }
+                if (tile < 0 || (unsigned int) tile >= tiles)
+                    break;
+                first[segments] = tile * TILE_ROWS;
+                rows[segments] = (first[segments] + TILE_ROWS < height ? TILE_ROWS : height - first[segments]);
+                if (stored + TILE_ROWS > capacity)
+                {
+                    capacity *= 2;
+                    picture = (unsigned char*) realloc(picture, capacity*width*sizeof(unsigned char));
+                }
+                unsigned char* tile_picture = picture + stored*width;
+                double t0 = MPI_Wtime();
+                mandelbrot_rows(tile_picture, first[segments], first[segments] + rows[segments], width, height,
+                                counts);
+                double t1 = MPI_Wtime();
+                stats[0] += t1 - t0;
+                stats[1] += 1;
+                stats[2] += rows[segments];
+                if (io == IO_INDEPENDENT)
+                {
+                    output(fh, tile_picture, first[segments]*width, rows[segments]*width);
+                    stats[3] += MPI_Wtime() - t1;
+                }
+                else
+                {
+                    stored += rows[segments];
+                    ++segments;
+                }
+            }
+    }
+    else
+    {
+        // The first height%nb_procs processes have one more row
+        unsigned int rest = height % nb_procs;
+        first[0] = rank * (height/nb_procs) + (rank < rest ? rank : rest);
+        rows[0] = height/nb_procs + (rank < rest);
+        picture = (unsigned char*) malloc(rows[0]*width*sizeof(unsigned char));
+        double t0 = MPI_Wtime();
+        mandelbrot_rows(picture, first[0], first[0] + rows[0], width, height, counts);
+        double t1 = MPI_Wtime();
+        stats[0] = t1 - t0;
+        stats[1] = 1;
+        stats[2] = rows[0];
+        if (io == IO_INDEPENDENT)
+        {
+            output(fh, picture, first[0]*width, rows[0]*width);
+            stats[3] = MPI_Wtime() - t1;
+        }
+        else
+            segments = 1;
+    }
+    // The collective write starts when all the processes have computed
+    // their rows: the output time does not include the load imbalance
+    if (io != IO_INDEPENDENT)
+        MPI_Barrier(MPI_COMM_WORLD);
+    double t0 = MPI_Wtime();
+    if (io == IO_COLLECTIVE)
+        output_collective(fh, picture, first, rows, segments, width, height);
+    else if (io == IO_COMPRESSED)
+        output_compressed(fh, picture, first, rows, segments, width, height);
+    MPI_File_close(&fh);
+    stats[3] += MPI_Wtime() - t0;
+    free(picture);
+    free(first);
+    free(rows);
 
-#pragma acc data copyout(picture[0:num_elements])
-{
-#pragma acc parallel loop
-    for (unsigned int i=0; i<local_height; ++i)
-        for (unsigned int j=0; j<width; ++j)
+    double* all_stats = rank == 0 ? (double*) malloc(4*nb_procs*sizeof(double)) : NULL;
+    MPI_Gather(stats, 4, MPI_DOUBLE, all_stats, 4, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    unsigned long int total_counts[2];
+    MPI_Reduce(counts, total_counts, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        double max_busy = 0., sum_busy = 0., max_io = 0.;
+        int workers = 0;
+        for (int p=0; p < nb_procs; ++p)
         {
-            float complex c;
-            c = min_re + j*step_w * (max_re - min_re) + \
-                I * (min_im +  ((i+first) * step_h) * (max_im - min_im));
-            picture[width*i+j] = (unsigned char)255 - mandelbrot_iterations(c);
+            if (all_stats[4*p+3] > max_io)
+                max_io = all_stats[4*p+3];
+            if (dynamic && p == 0 && nb_procs > 1)
+                continue;
+            printf("I am rank %2d, I computed %5.0f rows in %5.0f tiles in %10.5e s, output in %10.5e s\n", p,
+                   all_stats[4*p+2], all_stats[4*p+1], all_stats[4*p], all_stats[4*p+3]);
+            sum_busy += all_stats[4*p];
+            if (all_stats[4*p] > max_busy)
+                max_busy = all_stats[4*p];
+            ++workers;
         }
-}
-    output(picture, first*width, num_elements); 
+        printf("Load imbalance (max/mean time of the workers): %.3f\n", max_busy*workers/sum_busy);
+        printf("Max time of the processes: compute %10.5e s, output %10.5e s\n", max_busy, max_io);
+        printf("Iterations: %lu computed instead of %lu without the shortcuts (%.1f%% saved)\n", total_counts[1],
+               total_counts[0], 100.*(total_counts[0]-total_counts[1])/total_counts[0]);
+        free(all_stats);
+    }
     MPI_Finalize();
 
     // Measure time
     clock_gettime(CLOCK_MONOTONIC_RAW, &end);
     unsigned long int delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
-    printf("The time to generate the mandelbrot picture was %lu us\n", delta_us);
+    if (rank == 0)
+        printf("The time to generate the mandelbrot picture was %lu us\n", delta_us);
     return EXIT_SUCCESS;
 }
-
@@ -21,7 +21,7 @@ unsigned char mandelbrot_iterations(const float complex c)
     unsigned char max_iter = 255;
     unsigned char n = 0;
     float complex z = 0.0 + 0.0 * I;
-    while (abs(z*z) <= 2. && n < max_iter)
+    while (crealf(z)*crealf(z) + cimagf(z)*cimagf(z) <= 4.f && n < max_iter)
     {
         z = z*z + c;
         ++n;
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <complex.h>
 #include <time.h>
@@ -9,6 +10,9 @@
 #ifdef _OPENACC
    #include <openacc.h>
 #endif
+#if (defined(__AVX512F__) || defined(__AVX2__)) && defined(__x86_64__)
+   #include <immintrin.h>
+#endif
 void output(unsigned char* picture, unsigned int width, unsigned int height)
 {
    FILE* f = fopen("mandel.gray", "wb");
@@ -17,57 +21,555 @@ void output(unsigned char* picture, unsigned int width, unsigned int height)
 }
 
 #pragma acc routine seq
-unsigned char mandelbrot_iterations(const float complex c)
+unsigned char mandelbrot_orbit(const float cr, const float ci, int shortcuts, unsigned char* work)
 {
+    /**
+     * Number of iterations before the orbit of c = cr + i ci escapes
+     * With shortcuts, the points of the main cardioid and of the period-2
+     * bulb are in the set without iterating, and the orbit is compared with
+     * its points at the iterations 2, 4, 8... (Brent): if it comes back
+     * exactly to one of them, it is periodic and never escapes. The result
+     * is the same as without shortcuts.
+     * @param cr, ci: the point c
+     * @param shortcuts: 1 to use the shortcuts
+     * @param work(out): the number of iterations computed
+     */
     unsigned char max_iter = 255;
     unsigned char n = 0;
-    float complex z = 0.0 + 0.0 * I;
-    while (abs(z*z) <= 2. && n < max_iter)
+    *work = 0;
+    const float q = (cr - 0.25f)*(cr - 0.25f) + ci*ci;
+    if (shortcuts && (q*(q + (cr - 0.25f)) <= 0.25f*ci*ci || (cr + 1.f)*(cr + 1.f) + ci*ci <= 0.0625f))
+        return max_iter;
+    float zr = 0.;
+    float zi = 0.;
+    float saved_r = 0.;
+    float saved_i = 0.;
+    int next_save = 2;
+    // |z| <= 2 is tested as |z|^2 <= 4: no square root
+    while (zr*zr + zi*zi <= 4.f && n < max_iter)
     {
-        z = z*z + c;
+        float t = zr*zr - zi*zi + cr;
+        zi = 2.f*zr*zi + ci;
+        zr = t;
         ++n;
+        if (shortcuts)
+        {
+            if (zr == saved_r && zi == saved_i)
+            {
+                *work = n;
+                return max_iter;
+            }
+            if (n == next_save)
+            {
+                saved_r = zr;
+                saved_i = zi;
+                next_save *= 2;
+            }
+        }
     }
+    *work = n;
     return n;
 }
 
+#pragma acc routine seq
+unsigned char mandelbrot_iterations(const float complex c)
+{
+    unsigned char work;
+    return mandelbrot_orbit(crealf(c), cimagf(c), 1, &work);
+}
+
+// Number of rows of the tiles handed out to the threads
+#ifndef TILE_ROWS
+#define TILE_ROWS 16
+#endif
+
+void mandelbrot_rows(unsigned char* restrict picture, unsigned int first, unsigned int last,
+                     unsigned int width, unsigned int height)
+{
+    /**
+     * Compute the rows [first, last[ of the picture
+     * @param picture: a pointer to the whole picture
+     * @param first, last: the range of rows to compute
+     * @param width, height: the size of the picture
+     */
+    // Here we set the bonds of the coordinates of the picture.
+    const float min_re = -2;
+    const float max_re = 1;
+    const float min_im = -1;
+    const float max_im = 1;
+    const float step_w = 1./width;
+    const float step_h = 1./height;
+#pragma acc parallel loop copyout(picture[first*width:(last-first)*width])
+    for (unsigned int i=first; i<last; ++i)
+        for (unsigned int j=0; j<width; ++j)
+        {
+            float complex c;
+            c = min_re + j * step_w * (max_re - min_re) + \
+                I * (min_im + ( i * step_h) * (max_im - min_im));
+            picture[width*i+j] = (unsigned char) 255 - mandelbrot_iterations(c);
+        }
+}
+
+void mandelbrot_rows_simd(unsigned char* restrict picture, unsigned int first, unsigned int last,
+                          unsigned int width, unsigned int height)
+{
+    /**
+     * Compute the rows [first, last[ of the picture on the host, 16 (AVX-512)
+     * or 8 (AVX2) pixels per vector register
+     * The lanes iterate together until all of them escaped or reached
+     * max_iter: the lanes which escaped are masked and keep their number of
+     * iterations. The lanes in the main cardioid or the period-2 bulb are
+     * masked from the start and the periodic lanes when they are detected.
+     * The pixels are the ones of mandelbrot_rows, except a few
+     * on the boundary of the set if the compiler contracts the scalar
+     * operations into FMA differently.
+     * @param picture: a pointer to the whole picture
+     * @param first, last: the range of rows to compute
+     * @param width, height: the size of the picture
+     */
+    const float min_re = -2;
+    const float max_re = 1;
+    const float min_im = -1;
+    const float max_im = 1;
+    const float step_w = 1./width;
+    const float step_h = 1./height;
+    for (unsigned int i=first; i<last; ++i)
+    {
+        unsigned int j = 0;
+#if (defined(__AVX512F__) || defined(__AVX2__)) && defined(__x86_64__)
+        const float ci = min_im + (i * step_h) * (max_im - min_im);
+        const int max_iter = 255;
+#endif
+#if defined(__AVX512F__) && defined(__x86_64__)
+        const __m512 lanes = _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        for (; j+16 <= width; j += 16)
+        {
+            // Same operations as the scalar version for the coordinates
+            __m512 cr = _mm512_add_ps(_mm512_set1_ps(min_re),
+                            _mm512_mul_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_set1_ps((float) j), lanes),
+                                                        _mm512_set1_ps(step_w)),
+                                          _mm512_set1_ps(max_re - min_re)));
+            __m512 vci = _mm512_set1_ps(ci);
+            __m512 zr = _mm512_setzero_ps();
+            __m512 zi = _mm512_setzero_ps();
+            __m512 saved_r = _mm512_setzero_ps();
+            __m512 saved_i = _mm512_setzero_ps();
+            // The lanes in the main cardioid or in the period-2 bulb start with max_iter
+            __m512 x = _mm512_sub_ps(cr, _mm512_set1_ps(0.25f));
+            __m512 ci2 = _mm512_mul_ps(vci, vci);
+            __m512 q = _mm512_add_ps(_mm512_mul_ps(x, x), ci2);
+            __m512 x1 = _mm512_add_ps(cr, _mm512_set1_ps(1.f));
+            __mmask16 inside = _mm512_cmp_ps_mask(_mm512_mul_ps(q, _mm512_add_ps(q, x)),
+                                                  _mm512_mul_ps(_mm512_set1_ps(0.25f), ci2), _CMP_LE_OQ)
+                             | _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_mul_ps(x1, x1), ci2),
+                                                  _mm512_set1_ps(0.0625f), _CMP_LE_OQ);
+            __m512i n = _mm512_maskz_set1_epi32(inside, max_iter);
+            __mmask16 active = ~inside;
+            int next_save = 2;
+            for (int k=0; k < max_iter; ++k)
+            {
+                __m512 zr2 = _mm512_mul_ps(zr, zr);
+                __m512 zi2 = _mm512_mul_ps(zi, zi);
+                active = _mm512_mask_cmp_ps_mask(active, _mm512_add_ps(zr2, zi2), _mm512_set1_ps(4.f), _CMP_LE_OQ);
+                if (active == 0)
+                    break;
+                n = _mm512_mask_add_epi32(n, active, n, _mm512_set1_epi32(1));
+                __m512 t = _mm512_add_ps(_mm512_sub_ps(zr2, zi2), cr);
+                zi = _mm512_fmadd_ps(_mm512_add_ps(zr, zr), zi, vci);
+                zr = t;
+                // The lanes back to their saved point are periodic (Brent)
+                __mmask16 periodic = _mm512_mask_cmp_ps_mask(active, zr, saved_r, _CMP_EQ_OQ)
+                                   & _mm512_cmp_ps_mask(zi, saved_i, _CMP_EQ_OQ);
+                n = _mm512_mask_mov_epi32(n, periodic, _mm512_set1_epi32(max_iter));
+                active &= ~periodic;
+                if (k+1 == next_save)
+                {
+                    saved_r = zr;
+                    saved_i = zi;
+                    next_save *= 2;
+                }
+            }
+            __m128i iterations = _mm512_cvtepi32_epi8(n);
+            _mm_storeu_si128((__m128i*) &picture[width*i+j],
+                             _mm_sub_epi8(_mm_set1_epi8((char) 255), iterations));
+        }
+#elif defined(__AVX2__) && defined(__x86_64__)
+        const __m256 lanes = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+        for (; j+8 <= width; j += 8)
+        {
+            // Same operations as the scalar version for the coordinates
+            __m256 cr = _mm256_add_ps(_mm256_set1_ps(min_re),
+                            _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps((float) j), lanes),
+                                                        _mm256_set1_ps(step_w)),
+                                          _mm256_set1_ps(max_re - min_re)));
+            __m256 vci = _mm256_set1_ps(ci);
+            __m256 zr = _mm256_setzero_ps();
+            __m256 zi = _mm256_setzero_ps();
+            __m256 saved_r = _mm256_setzero_ps();
+            __m256 saved_i = _mm256_setzero_ps();
+            // The lanes in the main cardioid or in the period-2 bulb start with max_iter
+            __m256 x = _mm256_sub_ps(cr, _mm256_set1_ps(0.25f));
+            __m256 ci2 = _mm256_mul_ps(vci, vci);
+            __m256 q = _mm256_add_ps(_mm256_mul_ps(x, x), ci2);
+            __m256 x1 = _mm256_add_ps(cr, _mm256_set1_ps(1.f));
+            __m256 inside = _mm256_or_ps(
+                _mm256_cmp_ps(_mm256_mul_ps(q, _mm256_add_ps(q, x)), _mm256_mul_ps(_mm256_set1_ps(0.25f), ci2), _CMP_LE_OQ),
+                _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(x1, x1), ci2), _mm256_set1_ps(0.0625f), _CMP_LE_OQ));
+            __m256i n = _mm256_and_si256(_mm256_castps_si256(inside), _mm256_set1_epi32(max_iter));
+            // All bits set in the lanes which did not escape yet
+            __m256 active = _mm256_andnot_ps(inside, _mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+            int next_save = 2;
+            for (int k=0; k < max_iter; ++k)
+            {
+                __m256 zr2 = _mm256_mul_ps(zr, zr);
+                __m256 zi2 = _mm256_mul_ps(zi, zi);
+                active = _mm256_and_ps(active, _mm256_cmp_ps(_mm256_add_ps(zr2, zi2), _mm256_set1_ps(4.f), _CMP_LE_OQ));
+                if (_mm256_movemask_ps(active) == 0)
+                    break;
+                // The mask is -1 in the active lanes
+                n = _mm256_sub_epi32(n, _mm256_castps_si256(active));
+                __m256 t = _mm256_add_ps(_mm256_sub_ps(zr2, zi2), cr);
+#ifdef __FMA__
+                zi = _mm256_fmadd_ps(_mm256_add_ps(zr, zr), zi, vci);
+#else
+                zi = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(zr, zr), zi), vci);
+#endif
+                zr = t;
+                // The lanes back to their saved point are periodic (Brent)
+                __m256 periodic = _mm256_and_ps(active, _mm256_and_ps(_mm256_cmp_ps(zr, saved_r, _CMP_EQ_OQ),
+                                                                      _mm256_cmp_ps(zi, saved_i, _CMP_EQ_OQ)));
+                n = _mm256_blendv_epi8(n, _mm256_set1_epi32(max_iter), _mm256_castps_si256(periodic));
+                active = _mm256_andnot_ps(periodic, active);
+                if (k+1 == next_save)
+                {
+                    saved_r = zr;
+                    saved_i = zi;
+                    next_save *= 2;
+                }
+            }
+            // 255 - n for the 8 lanes, packed to bytes
+            __m256i pixels = _mm256_sub_epi32(_mm256_set1_epi32(255), n);
+            __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(pixels), _mm256_extracti128_si256(pixels, 1));
+            _mm_storel_epi64((__m128i*) &picture[width*i+j], _mm_packus_epi16(words, words));
+        }
+#endif
+        // Remaining pixels of the row (all of them without AVX2)
+        for (; j<width; ++j)
+        {
+            float complex c;
+            c = min_re + j * step_w * (max_re - min_re) + \
+                I * (min_im + ( i * step_h) * (max_im - min_im));
+            picture[width*i+j] = (unsigned char) 255 - mandelbrot_iterations(c);
+        }
+    }
+}
+
+double elapsed(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.e9;
+}
+
+unsigned long int mandelbrot_work(unsigned char* restrict picture, unsigned int width, unsigned int height,
+                                  int shortcuts)
+{
+    /**
+     * Compute the picture on one thread with or without the shortcuts
+     * @return the number of iterations computed
+     */
+    const float min_re = -2;
+    const float max_re = 1;
+    const float min_im = -1;
+    const float max_im = 1;
+    const float step_w = 1./width;
+    const float step_h = 1./height;
+    unsigned long int iterations = 0;
+    for (unsigned int i=0; i<height; ++i)
+        for (unsigned int j=0; j<width; ++j)
+        {
+            unsigned char work;
+            float complex c;
+            c = min_re + j * step_w * (max_re - min_re) + \
+                I * (min_im + ( i * step_h) * (max_im - min_im));
+            picture[width*i+j] = (unsigned char) 255 - mandelbrot_orbit(crealf(c), cimagf(c), shortcuts, &work);
+            iterations += work;
+        }
+    return iterations;
+}
+
+void benchmark(unsigned int width, unsigned int height)
+{
+    /**
+     * Compare the scalar kernel without and with the shortcuts and the
+     * vector kernel on one thread
+     */
+    unsigned char* plain = (unsigned char*) malloc(width*height*sizeof(unsigned char));
+    unsigned char* scalar = (unsigned char*) malloc(width*height*sizeof(unsigned char));
+    unsigned char* vector = (unsigned char*) malloc(width*height*sizeof(unsigned char));
+    struct timespec t0, t1, t2, t3;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+    unsigned long int plain_iterations = mandelbrot_work(plain, width, height, 0);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+    unsigned long int iterations = mandelbrot_work(scalar, width, height, 1);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t2);
+    mandelbrot_rows_simd(vector, 0, height, width, height);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t3);
+    unsigned long int differences = 0, vector_differences = 0;
+    for (size_t k=0; k < (size_t) width*height; ++k)
+    {
+        differences += plain[k] != scalar[k];
+        vector_differences += plain[k] != vector[k];
+    }
+#if defined(__AVX512F__) && defined(__x86_64__)
+    const char* isa = "AVX-512, 16";
+#elif defined(__AVX2__) && defined(__x86_64__)
+    const char* isa = "AVX2, 8";
+#else
+    const char* isa = "no vector extension, 1";
+#endif
+    printf("Scalar kernel:                 %10.5e s, %8.2f Mpixels/s, %lu iterations\n", elapsed(t0, t1),
+           width*height/elapsed(t0, t1)/1.e6, plain_iterations);
+    printf("Scalar kernel with shortcuts:  %10.5e s, %8.2f Mpixels/s, %lu iterations (%.1f%% saved)\n",
+           elapsed(t1, t2), width*height/elapsed(t1, t2)/1.e6, iterations,
+           100.*(plain_iterations-iterations)/plain_iterations);
+    // The speedup of the vector kernel is measured against the scalar kernel with the same shortcuts
+    printf("Vector kernel with shortcuts:  %10.5e s, %8.2f Mpixels/s (%s pixels per register), speedup %.2f\n",
+           elapsed(t2, t3), width*height/elapsed(t2, t3)/1.e6, isa, elapsed(t1, t2)/elapsed(t2, t3));
+    printf("%lu (scalar) and %lu (vector) pixels out of %u differ\n", differences, vector_differences,
+           width*height);
+    free(plain);
+    free(scalar);
+    free(vector);
+}
+
+// Lattice points on a side of the blocks of the progressive rendering
+#ifndef SUBDIVISION_BLOCK
+#define SUBDIVISION_BLOCK 16
+#endif
+
+unsigned char mandelbrot_pixel(unsigned char* restrict picture, unsigned char* restrict known, unsigned int i,
+                               unsigned int j, unsigned int width, unsigned int height, unsigned long int* computed)
+{
+    /**
+     * Value of the pixel (i, j), computed only if it is not known yet
+     * @param known: 1 for the pixels already computed or filled
+     * @param computed: incremented when the pixel is computed
+     */
+    const size_t k = (size_t) width*i + j;
+    if (!known[k])
+    {
+        const float min_re = -2;
+        const float max_re = 1;
+        const float min_im = -1;
+        const float max_im = 1;
+        const float step_w = 1./width;
+        const float step_h = 1./height;
+        float complex c;
+        c = min_re + j * step_w * (max_re - min_re) + \
+            I * (min_im + ( i * step_h) * (max_im - min_im));
+        picture[k] = (unsigned char) 255 - mandelbrot_iterations(c);
+        known[k] = 1;
+        ++*computed;
+    }
+    return picture[k];
+}
+
+void mandelbrot_subdivide(unsigned char* restrict picture, unsigned char* restrict known,
+                          unsigned int i0, unsigned int i1, unsigned int j0, unsigned int j1, unsigned int step,
+                          unsigned int width, unsigned int height, unsigned long int* computed,
+                          unsigned long int* filled)
+{
+    /**
+     * Compute the points of the lattice of the given step in the rectangle
+     * [i0, i1] x [j0, j1] (Mariani-Silver)
+     * If all the points of the border have the same value, the inside is
+     * filled with it without iterating: the set is connected and the bands
+     * of equal iterations have no holes, except for the small copies of the
+     * set which are smaller than the rectangle. Otherwise the rectangle is
+     * cut in two along its longer side.
+     * @param i0, i1, j0, j1: the corners, multiples of step
+     * @param computed, filled: incremented by the number of pixels computed and filled
+     */
+    const unsigned char value = mandelbrot_pixel(picture, known, i0, j0, width, height, computed);
+    int uniform = 1;
+    for (unsigned int j=j0; j<=j1; j+=step)
+        uniform &= (mandelbrot_pixel(picture, known, i0, j, width, height, computed) == value) &
+                   (mandelbrot_pixel(picture, known, i1, j, width, height, computed) == value);
+    for (unsigned int i=i0; i<=i1; i+=step)
+        uniform &= (mandelbrot_pixel(picture, known, i, j0, width, height, computed) == value) &
+                   (mandelbrot_pixel(picture, known, i, j1, width, height, computed) == value);
+    const unsigned int rows = (i1-i0) / step;
+    const unsigned int cols = (j1-j0) / step;
+    if (rows < 2 || cols < 2)
+        return;
+    if (uniform || rows <= 4 || cols <= 4)
+    {
+        // Fill the inside, or compute it when the rectangle is too small to cut
+        for (unsigned int i=i0+step; i<i1; i+=step)
+            for (unsigned int j=j0+step; j<j1; j+=step)
+            {
+                const size_t k = (size_t) width*i + j;
+                if (uniform && !known[k])
+                {
+                    picture[k] = value;
+                    known[k] = 1;
+                    ++*filled;
+                }
+                else
+                    mandelbrot_pixel(picture, known, i, j, width, height, computed);
+            }
+        return;
+    }
+    if (rows >= cols)
+    {
+        const unsigned int middle = i0 + rows/2*step;
+        mandelbrot_subdivide(picture, known, i0, middle, j0, j1, step, width, height, computed, filled);
+        mandelbrot_subdivide(picture, known, middle, i1, j0, j1, step, width, height, computed, filled);
+    }
+    else
+    {
+        const unsigned int middle = j0 + cols/2*step;
+        mandelbrot_subdivide(picture, known, i0, i1, j0, middle, step, width, height, computed, filled);
+        mandelbrot_subdivide(picture, known, i0, i1, middle, j1, step, width, height, computed, filled);
+    }
+}
+
+void progressive(unsigned int width, unsigned int height)
+{
+    /**
+     * Render the picture at 1/16, 1/4 then all the pixels
+     * Each level computes the points of a lattice of step 4, 2 then 1 which
+     * were not computed by the previous levels, by blocks of
+     * SUBDIVISION_BLOCK^2 points subdivided with mandelbrot_subdivide. The
+     * lines between the blocks are computed first so that the blocks share
+     * no pixel. Each level is written to mandel.gray, the missing pixels
+     * taking the value of the point of the lattice above and on the left.
+     * The final picture is compared with the one computed pixel by pixel.
+     */
+    unsigned char* picture = (unsigned char*) malloc((size_t) width*height*sizeof(unsigned char));
+    unsigned char* known = (unsigned char*) calloc((size_t) width*height, sizeof(unsigned char));
+    unsigned char* preview = (unsigned char*) malloc((size_t) width*height*sizeof(unsigned char));
+    unsigned char* exact = (unsigned char*) malloc((size_t) width*height*sizeof(unsigned char));
+    struct timespec t0, t1;
+    double total = 0.;
+
+    for (unsigned int step=4; step >= 1; step/=2)
+    {
+        // Last row and column of the lattice and number of blocks. The
+        // blocks_i+1 lines of blocks are distinct rows (one row when the
+        // lattice has a single row and no block), same for the columns.
+        const unsigned int last_i = (height-1) / step * step;
+        const unsigned int last_j = (width-1) / step * step;
+        const unsigned int block = SUBDIVISION_BLOCK * step;
+        const unsigned int blocks_i = last_i / block + (last_i % block != 0);
+        const unsigned int blocks_j = last_j / block + (last_j % block != 0);
+        unsigned long int computed = 0, filled = 0;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+#pragma omp parallel for schedule(dynamic) reduction(+:computed)
+        for (unsigned int b=0; b<=blocks_i; ++b)
+        {
+            const unsigned int i = b*block < last_i ? b*block : last_i;
+            for (unsigned int j=0; j<=last_j; j+=step)
+                mandelbrot_pixel(picture, known, i, j, width, height, &computed);
+        }
+#pragma omp parallel for schedule(dynamic) reduction(+:computed)
+        for (unsigned int b=0; b<=blocks_j; ++b)
+        {
+            const unsigned int j = b*block < last_j ? b*block : last_j;
+            for (unsigned int i=0; i<=last_i; i+=step)
+                mandelbrot_pixel(picture, known, i, j, width, height, &computed);
+        }
+#pragma omp parallel for collapse(2) schedule(dynamic) reduction(+:computed, filled)
+        for (unsigned int bi=0; bi<blocks_i; ++bi)
+            for (unsigned int bj=0; bj<blocks_j; ++bj)
+            {
+                const unsigned int i1 = (bi+1)*block < last_i ? (bi+1)*block : last_i;
+                const unsigned int j1 = (bj+1)*block < last_j ? (bj+1)*block : last_j;
+                mandelbrot_subdivide(picture, known, bi*block, i1, bj*block, j1, step, width, height,
+                                     &computed, &filled);
+            }
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+        total += elapsed(t0, t1);
+        printf("Level 1/%-2u: %10.5e s, %9lu pixels computed, %9lu filled (%10.5e s in total)\n",
+               step*step, elapsed(t0, t1), computed, filled, total);
+
+#pragma omp parallel for
+        for (unsigned int i=0; i<height; ++i)
+            for (unsigned int j=0; j<width; ++j)
+                preview[(size_t) width*i+j] = picture[(size_t) width*(i/step*step) + j/step*step];
+        output(preview, width, height);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+#pragma omp parallel for schedule(dynamic)
+    for (unsigned int i=0; i<height; i+=TILE_ROWS)
+        mandelbrot_rows(exact, i, i + TILE_ROWS < height ? i + TILE_ROWS : height, width, height);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+    unsigned long int differences = 0;
+    for (size_t k=0; k < (size_t) width*height; ++k)
+        differences += picture[k] != exact[k];
+    printf("Pixel by pixel:  %10.5e s, speedup %.2f, %lu pixels out of %u differ\n", elapsed(t0, t1),
+           elapsed(t0, t1)/total, differences, width*height);
+    free(picture);
+    free(known);
+    free(preview);
+    free(exact);
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 3)
     {
         printf("Please give width and height of the world.");
+        printf(" Add \"static\" to give a fixed block of rows to each thread,");
+        printf(" \"simd\" to use the vector kernel on the host, \"bench\" to compare the kernels");
+        printf(" or \"progressive\" to render 1/16, 1/4 then all the pixels.\n");
         return 1;
     }
     unsigned int width = (unsigned int) atoi(argv[1]);
-    float step_w = 1./width;
     unsigned int height = (unsigned int) atoi(argv[2]);
-    float step_h = 1./height;
+    int dynamic = 1;
+    void (*kernel)(unsigned char*, unsigned int, unsigned int, unsigned int, unsigned int) = mandelbrot_rows;
+    for (int a=3; a < argc; ++a)
+    {
+        if (strcmp(argv[a], "static") == 0)
+            dynamic = 0;
+        else if (strcmp(argv[a], "simd") == 0)
+            kernel = mandelbrot_rows_simd;
+        else if (strcmp(argv[a], "bench") == 0)
+        {
+            benchmark(width, height);
+            return 0;
+        }
+        else if (strcmp(argv[a], "progressive") == 0)
+        {
+            progressive(width, height);
+            return 0;
+        }
+    }
     unsigned char* restrict picture = (unsigned char*) malloc(width*height*sizeof(unsigned char));
-    // Here we set the bonds of the coordinates of the picture.
-    const float min_re = -2;
-    const float max_re = 1;
-    const float min_im = -1;
-    const float max_im = 1;
+    // Next tile to hand out
+    unsigned int next_tile = 0;
+    const unsigned int tiles = (height + TILE_ROWS-1) / TILE_ROWS;
+    double max_busy = 0., sum_busy = 0.;
 
     struct timespec end, start;
     clock_gettime(CLOCK_MONOTONIC_RAW, &start);
 
-    int rank = 0;
-    unsigned int first = 0;
-    unsigned int last = height;
-    int num_elements = width*height;
-#pragma omp parallel private(first, last, rank) shared(picture) firstprivate(height, width, min_re, max_re, min_im, max_im, step_h, step_w, num_elements) default(none)
+#pragma omp parallel shared(picture, next_tile, max_busy, sum_busy) firstprivate(height, width, tiles, dynamic, kernel) default(none)
 {
+    int rank = 0;
+    int num_threads = 1;
+    struct timespec t0, t1;
+    double busy = 0.;
+    unsigned int num_tiles = 0;
+    unsigned int num_rows = 0;
 #ifdef _OPENMP
     rank = omp_get_thread_num();
-    int num_threads = omp_get_num_threads();
-    first = rank * (height/num_threads);
-    last  = (rank + 1) * (height/num_threads);
-    num_elements = width*height/num_threads;
+    num_threads = omp_get_num_threads();
 #pragma omp master
 {
-    printf("Using OpenMP\n");
+    printf("Using OpenMP with %s scheduling\n", dynamic ? "dynamic" : "static");
 }
-    printf("I am rank %2d and my range is [%5d, %5d[ ie %10d elements\n", rank, first, last, num_elements);
 #endif
     
 #ifdef _OPENACC
@@ -77,22 +579,56 @@ int main(int argc, char** argv)
     printf("I am rank %2d. I am using GPU %d\n", rank, acc_get_device_num(type));
 #endif
 
-#pragma acc parallel copyout(picture[first*width:num_elements])
+    if (dynamic)
     {
-    #pragma acc loop 
-    for (unsigned int i=first; i<last; ++i)
-        for (unsigned int j=0; j<width; ++j)
+        // Each thread takes the next tile until there is none left: the
+        // threads which get the rows through the set take fewer tiles
+        for (;;)
         {
-            float complex c;
-            c = min_re + j * step_w * (max_re - min_re) + \
-                I * (min_im + ( i * step_h) * (max_im - min_im));
-            picture[width*i+j] = (unsigned char) 255 - mandelbrot_iterations(c);
+            unsigned int tile;
+#pragma omp atomic capture
+            tile = next_tile++;
+            if (tile >= tiles)
+                break;
+            unsigned int first = tile * TILE_ROWS;
+            unsigned int last = first + TILE_ROWS < height ? first + TILE_ROWS : height;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+            kernel(picture, first, last, width, height);
+            clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+            busy += elapsed(t0, t1);
+            ++num_tiles;
+            num_rows += last-first;
         }
     }
+    else
+    {
+        // A fixed block of rows per thread, the first height%num_threads
+        // threads having one more row
+        unsigned int rest = height % num_threads;
+        unsigned int first = rank * (height/num_threads) + (rank < rest ? rank : rest);
+        unsigned int last = first + height/num_threads + (rank < rest);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+        kernel(picture, first, last, width, height);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+        busy = elapsed(t0, t1);
+        num_tiles = 1;
+        num_rows = last-first;
+    }
+    printf("I am rank %2d, I computed %5u rows in %5u tiles in %10.5e s\n", rank, num_rows, num_tiles, busy);
+#pragma omp critical
+{
+    sum_busy += busy;
+    if (busy > max_busy)
+        max_busy = busy;
+}
+#pragma omp barrier
+#pragma omp master
+{
+    printf("Load imbalance (max/mean time of the threads): %.3f\n", max_busy*num_threads/sum_busy);
+}
 }
     // Measure time
     clock_gettime(CLOCK_MONOTONIC_RAW, &end);
-    unsigned long int delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
-    printf("The time to generate the mandelbrot picture was %10.5e s\n", delta_us/1.e6);
+    printf("The time to generate the mandelbrot picture was %10.5e s\n", elapsed(start, end));
     output(picture, width, height);
 }
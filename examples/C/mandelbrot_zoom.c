@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+/**
+ * Mandelbrot renderer for any region and number of iterations
+ *
+ * The region is given by its centre and by the half width of the picture
+ * (the pixels are square). The centre is read with about 32 significant
+ * digits. The arithmetic depends on the size of the pixels relative to the
+ * coordinates:
+ *   - float for the wide views, as mandelbrot_openmp_solution.c
+ *   - double when the pixels are too close for float
+ *   - perturbation when they are too close for double: the orbit of the
+ *     centre (the reference) is computed once in double-double arithmetic
+ *     and each pixel only iterates its difference with the reference in
+ *     double. When the orbit of the pixel gets closer to 0 than the
+ *     difference, or at the end of the reference, the difference is
+ *     rebased on the start of the reference. Double-double limits the depth
+ *     to a half width of about 1e-30 times the coordinates.
+ * The picture is written to mandel.gray: 255 - n%255 for a point which
+ * escaped after n iterations, 0 (black) for the points of the set, as the
+ * other Mandelbrot examples for max_iter = 255. This example runs on the host.
+ *
+ * Usage: ./mandelbrot_zoom width height [center_re center_im half_width [max_iter [float|double|perturbation]]]
+ *   e.g. ./mandelbrot_zoom 1920 1080 -0.743643887037158704752191506114774 0.131825904205311970493132056385139 1e-25 50000
+ *
+ * List of functions:
+ *   - uint32_t iterations_float(float cr, float ci, uint32_t max_iter)
+ *   - uint32_t iterations_double(double cr, double ci, uint32_t max_iter)
+ *   - uint32_t reference_orbit(dd cr, dd ci, uint32_t max_iter, double* zr, double* zi)
+ *     the orbit of the centre, rounded to double
+ *   - uint32_t iterations_perturbation(const double* zr, const double* zi, uint32_t length,
+ *                                      double cr0, double ci0, double dcr, double dci, uint32_t max_iter)
+ *     the iterations of the point at (dcr, dci) from the centre (cr0, ci0)
+ */
+
+enum { PRECISION_FLOAT, PRECISION_DOUBLE, PRECISION_PERTURBATION };
+const char* precision_names[] = {"float", "double", "perturbation"};
+// Smallest size of the pixels relative to the coordinates for float and double
+#define FLOAT_SPACING 1.e-5
+#define DOUBLE_SPACING 1.e-13
+
+// Double-double number: the unevaluated sum hi + lo with |lo| <= ulp(hi)/2
+typedef struct
+{
+    double hi;
+    double lo;
+} dd;
+
+dd quick_two_sum(double a, double b)
+{
+    // Exact sum of a and b if |a| >= |b|
+    dd r;
+    r.hi = a + b;
+    r.lo = b - (r.hi - a);
+    return r;
+}
+
+dd dd_add(dd a, dd b)
+{
+    double s = a.hi + b.hi;
+    double v = s - a.hi;
+    double e = (a.hi - (s - v)) + (b.hi - v);
+    return quick_two_sum(s, e + a.lo + b.lo);
+}
+
+dd dd_mul(dd a, dd b)
+{
+    double p = a.hi * b.hi;
+    double e = fma(a.hi, b.hi, -p);
+    return quick_two_sum(p, e + a.hi*b.lo + a.lo*b.hi);
+}
+
+dd dd_mul_d(dd a, double b)
+{
+    double p = a.hi * b;
+    double e = fma(a.hi, b, -p);
+    return quick_two_sum(p, e + a.lo*b);
+}
+
+dd dd_div_d(dd a, double b)
+{
+    double q1 = a.hi / b;
+    dd r = dd_add(a, dd_mul_d((dd) {q1, 0.}, -b));
+    return quick_two_sum(q1, r.hi / b);
+}
+
+dd dd_parse(const char* text)
+{
+    /**
+     * Read a decimal number (sign, digits, point, exponent) in double-double
+     */
+    dd x = {0., 0.};
+    int negative = 0, exponent = 0, fraction = 0;
+    const char* p = text;
+    if (*p == '-' || *p == '+')
+        negative = *p++ == '-';
+    for (; (*p >= '0' && *p <= '9') || *p == '.'; ++p)
+    {
+        if (*p == '.')
+        {
+            fraction = 1;
+            continue;
+        }
+        x = dd_add(dd_mul_d(x, 10.), (dd) {*p - '0', 0.});
+        exponent -= fraction;
+    }
+    if (*p == 'e' || *p == 'E')
+        exponent += atoi(p+1);
+    for (; exponent > 0; --exponent)
+        x = dd_mul_d(x, 10.);
+    for (; exponent < 0; ++exponent)
+        x = dd_div_d(x, 10.);
+    if (negative)
+    {
+        x.hi = -x.hi;
+        x.lo = -x.lo;
+    }
+    return x;
+}
+
+uint32_t iterations_float(float cr, float ci, uint32_t max_iter)
+{
+    /**
+     * Number of iterations before the orbit of c escapes, in float
+     * The points of the main cardioid and of the period-2 bulb are in the
+     * set, and an orbit which comes back exactly to one of its points at
+     * the iterations 2, 4, 8... (Brent) is periodic.
+     */
+    const float q = (cr - 0.25f)*(cr - 0.25f) + ci*ci;
+    if (q*(q + (cr - 0.25f)) <= 0.25f*ci*ci || (cr + 1.f)*(cr + 1.f) + ci*ci <= 0.0625f)
+        return max_iter;
+    uint32_t n = 0;
+    uint32_t next_save = 2;
+    float zr = 0.f, zi = 0.f;
+    float saved_r = 0.f, saved_i = 0.f;
+    while (zr*zr + zi*zi <= 4.f && n < max_iter)
+    {
+        float t = zr*zr - zi*zi + cr;
+        zi = 2.f*zr*zi + ci;
+        zr = t;
+        ++n;
+        if (zr == saved_r && zi == saved_i)
+            return max_iter;
+        if (n == next_save)
+        {
+            saved_r = zr;
+            saved_i = zi;
+            next_save *= 2;
+        }
+    }
+    return n;
+}
+
+uint32_t iterations_double(double cr, double ci, uint32_t max_iter)
+{
+    /**
+     * Number of iterations before the orbit of c escapes, in double
+     * (same shortcuts as iterations_float)
+     */
+    const double q = (cr - 0.25)*(cr - 0.25) + ci*ci;
+    if (q*(q + (cr - 0.25)) <= 0.25*ci*ci || (cr + 1.)*(cr + 1.) + ci*ci <= 0.0625)
+        return max_iter;
+    uint32_t n = 0;
+    uint32_t next_save = 2;
+    double zr = 0., zi = 0.;
+    double saved_r = 0., saved_i = 0.;
+    while (zr*zr + zi*zi <= 4. && n < max_iter)
+    {
+        double t = zr*zr - zi*zi + cr;
+        zi = 2.*zr*zi + ci;
+        zr = t;
+        ++n;
+        if (zr == saved_r && zi == saved_i)
+            return max_iter;
+        if (n == next_save)
+        {
+            saved_r = zr;
+            saved_i = zi;
+            next_save *= 2;
+        }
+    }
+    return n;
+}
+
+uint32_t reference_orbit(dd cr, dd ci, uint32_t max_iter, double* restrict zr, double* restrict zi)
+{
+    /**
+     * Compute the orbit of the centre in double-double
+     * @param cr, ci: the centre
+     * @param max_iter: the maximum number of iterations
+     * @param zr, zi(out): the points 0 to length of the orbit rounded to double
+     * @return the length of the orbit: the iteration where it escapes or max_iter
+     */
+    dd r = {0., 0.}, i = {0., 0.};
+    uint32_t n = 0;
+    zr[0] = 0.;
+    zi[0] = 0.;
+    while (zr[n]*zr[n] + zi[n]*zi[n] <= 4. && n < max_iter)
+    {
+        dd r2 = dd_mul(r, r);
+        dd i2 = dd_mul(i, i);
+        dd ri = dd_mul(r, i);
+        r = dd_add(dd_add(r2, (dd) {-i2.hi, -i2.lo}), cr);
+        i = dd_add(dd_mul_d(ri, 2.), ci);
+        ++n;
+        zr[n] = r.hi + r.lo;
+        zi[n] = i.hi + i.lo;
+    }
+    return n;
+}
+
+uint32_t iterations_perturbation(const double* restrict zr, const double* restrict zi, uint32_t length,
+                                 double cr0, double ci0, double dcr, double dci, uint32_t max_iter)
+{
+    /**
+     * Number of iterations before the orbit of the point at (dcr, dci) from
+     * the centre escapes
+     * The orbit is z = Z_m + d where Z is the reference and d the difference:
+     * d <- (2 Z_m + d) d + dc. When |z| < |d| or at the end of the reference,
+     * z becomes the difference with Z_0 = 0 (rebasing), which removes the
+     * loss of precision of d (glitches). The points of the main cardioid and
+     * of the period-2 bulb are found with c in double, which is enough for
+     * these tests.
+     */
+    const double cr = cr0 + dcr, ci = ci0 + dci;
+    const double q = (cr - 0.25)*(cr - 0.25) + ci*ci;
+    if (q*(q + (cr - 0.25)) <= 0.25*ci*ci || (cr + 1.)*(cr + 1.) + ci*ci <= 0.0625)
+        return max_iter;
+    uint32_t n = 0;
+    uint32_t m = 0;
+    double dr = 0., di = 0.;
+    while (n < max_iter)
+    {
+        const double r = zr[m] + dr;
+        const double i = zi[m] + di;
+        const double norm = r*r + i*i;
+        if (norm > 4.)
+            break;
+        if (norm < dr*dr + di*di || m == length)
+        {
+            dr = r;
+            di = i;
+            m = 0;
+        }
+        const double t = 2.*(zr[m]*dr - zi[m]*di) + dr*dr - di*di + dcr;
+        di = 2.*(zr[m]*di + zi[m]*dr) + 2.*dr*di + dci;
+        dr = t;
+        ++m;
+        ++n;
+    }
+    return n;
+}
+
+void output(unsigned char* picture, unsigned int width, unsigned int height)
+{
+   FILE* f = fopen("mandel.gray", "wb");
+   fwrite(picture, sizeof(unsigned char), (size_t) width*height, f);
+   fclose(f);
+}
+
+double elapsed(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.e9;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        printf("Please give width and height of the picture");
+        printf(" [center_re center_im half_width [max_iter [float|double|perturbation]]]\n");
+        return 1;
+    }
+    unsigned int width = (unsigned int) atoi(argv[1]);
+    unsigned int height = (unsigned int) atoi(argv[2]);
+    dd center_re = dd_parse(argc >= 6 ? argv[3] : "-0.5");
+    dd center_im = dd_parse(argc >= 6 ? argv[4] : "0");
+    double half_width = argc >= 6 ? strtod(argv[5], NULL) : 1.5;
+    uint32_t max_iter = argc >= 7 ? (uint32_t) strtoul(argv[6], NULL, 10) : 255;
+    if (width == 0 || height == 0 || half_width <= 0. || max_iter == 0)
+    {
+        printf("The size, the half width and the number of iterations must be positive\n");
+        return 1;
+    }
+
+    // Size of the pixels relative to the coordinates
+    const double spacing = 2.*half_width/width;
+    const double relative = spacing / (fabs(center_re.hi) + fabs(center_im.hi) + half_width);
+    int precision = relative > FLOAT_SPACING ? PRECISION_FLOAT :
+                    relative > DOUBLE_SPACING ? PRECISION_DOUBLE : PRECISION_PERTURBATION;
+    for (int p=PRECISION_FLOAT; argc >= 8 && p <= PRECISION_PERTURBATION; ++p)
+        if (strcmp(argv[7], precision_names[p]) == 0)
+            precision = p;
+    printf("Pixel size %.3e (%.3e relative), %u iterations at most, %s arithmetic\n", spacing, relative,
+           max_iter, precision_names[precision]);
+
+    unsigned char* restrict picture = (unsigned char*) malloc((size_t) width*height*sizeof(unsigned char));
+    double* zr = NULL;
+    double* zi = NULL;
+    uint32_t length = 0;
+    struct timespec end, start, reference;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    if (precision == PRECISION_PERTURBATION)
+    {
+        zr = (double*) malloc(((size_t) max_iter+1)*sizeof(double));
+        zi = (double*) malloc(((size_t) max_iter+1)*sizeof(double));
+        if (zr == NULL || zi == NULL)
+        {
+            printf("Not enough memory for a reference orbit of %u iterations\n", max_iter);
+            return 1;
+        }
+        length = reference_orbit(center_re, center_im, max_iter, zr, zi);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &reference);
+
+    uint64_t total = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:total)
+    for (unsigned int i=0; i<height; ++i)
+        for (unsigned int j=0; j<width; ++j)
+        {
+            // Offset of the pixel from the centre, the imaginary part increasing downwards
+            const double dcr = (j - 0.5*width) * spacing;
+            const double dci = (i - 0.5*height) * spacing;
+            uint32_t n;
+            if (precision == PRECISION_FLOAT)
+                n = iterations_float((float) (center_re.hi + dcr), (float) (center_im.hi + dci), max_iter);
+            else if (precision == PRECISION_DOUBLE)
+                n = iterations_double(center_re.hi + dcr, center_im.hi + dci, max_iter);
+            else
+                n = iterations_perturbation(zr, zi, length, center_re.hi, center_im.hi, dcr, dci, max_iter);
+            total += n;
+            picture[(size_t) width*i+j] = n == max_iter ? 0 : (unsigned char) (255 - n%255);
+        }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+    if (precision == PRECISION_PERTURBATION)
+        printf("The reference orbit of %u iterations took %10.5e s\n", length, elapsed(start, reference));
+    printf("The time to generate the mandelbrot picture was %10.5e s (%.2f Mpixels/s, %.3e iterations)\n",
+           elapsed(start, end), (double) width*height/elapsed(start, end)/1.e6, (double) total);
+    output(picture, width, height);
+    free(picture);
+    free(zr);
+    free(zi);
+    return 0;
+}
@@ -0,0 +1,631 @@
+#ifndef MATRIX_FORMATS_H
+#define MATRIX_FORMATS_H
+/**
+ * Square matrices stored in the format fitting their structure
+ *
+ * The structure of a matrix is given at its creation by the offsets j-i of
+ * its non zero diagonals, or by no offset for a full matrix. create_mat
+ * chooses the format taking the least memory:
+ *   - MAT_DIAGONAL: the main diagonal only, dim values
+ *   - MAT_BANDED: the band [-lower, upper] holding the diagonals, dim rows of
+ *     width = lower+upper+1 values, row i starting with the element (i, i-lower)
+ *     (8 width dim bytes)
+ *   - MAT_CSR: the non zero elements row after row (compressed sparse rows),
+ *     the elements of row i being row_ptr[i] to row_ptr[i+1]-1 (12 bytes per
+ *     element): the bands with few diagonals, e.g. a 5-point stencil on a grid
+ *     of nx columns has the diagonals 0, +-1 and +-nx
+ *   - MAT_DENSE: dim x dim values (8 dim^2 bytes)
+ * The elements of the band or of the rows which are not in the matrix (on the
+ * edges) are stored as 0.
+ *
+ * The product C = A*B runs a kernel depending on the formats:
+ *   - diagonal x any or any x diagonal: scaling of the rows or the columns
+ *   - banded x banded: dim x width_C x min(width_A, width_B) operations
+ *   - dense x dense: blocks of MAT_TILE x MAT_TILE elements of C per gang, or
+ *     packed panels (gemm_packed.h) on the host
+ *   - otherwise, row by row: each row i of C is the sum of the rows k of B
+ *     scaled by the non zero a_ik, so only the non zero elements are used
+ * Each element of C is computed by one thread: there is no atomic operation.
+ * The format of C is chosen by create_product from the structure of A*B.
+ *
+ * The matrices live on the device. The creation and the initialisation are
+ * asynchronous on the queue given, and the products wait for the queues of
+ * their three matrices.
+ *
+ * List of functions:
+ *   - matrix* create_mat(int dim, int ndiags, const int* offsets, int stream)
+ *     create a matrix of the structure given (offsets in increasing order, none if full)
+ *   - matrix* create_mat_format(int dim, int ndiags, const int* offsets, int format, int stream)
+ *     create a matrix in a given format
+ *   - matrix* create_product(const matrix* A, const matrix* B, int stream)
+ *     create a matrix of the structure of A*B
+ *   - void init_mat(matrix* mat, const double* diags, int stream)
+ *     set the diagonal offsets[d] to diags[d] and the other elements to 0
+ *   - void mat_multiply(const matrix* A, const matrix* B, matrix* C)
+ *     C = A*B
+ *   - double mat_checksum(const matrix* mat)
+ *     sum of the elements weighted by their position
+ *   - void mat_update_self(matrix* mat)
+ *     copy the values from the device to the host
+ *   - double mat_get(const matrix* mat, int i, int j)
+ *     element (i, j) on the host
+ *   - void free_mat(matrix* mat)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gemm_packed.h"
+
+#ifndef MAT_TILE
+#define MAT_TILE 32
+#endif
+
+enum { MAT_DENSE, MAT_DIAGONAL, MAT_BANDED, MAT_CSR };
+const char* mat_format_names[] = {"dense", "diagonal", "banded", "CSR"};
+
+typedef struct
+{
+    int format;
+    int dim;
+    // Queue of the last initialisation, waited for by the products
+    int queue;
+    // Structure: the offsets of the non zero diagonals in increasing order,
+    // none for a full matrix, and their values set by init_mat
+    int ndiags;
+    int* offsets;
+    double* diags;
+    // Band [-lower, upper] holding the non zero diagonals
+    int lower, upper, width;
+    // Number of non zero elements and of values stored
+    size_t nnz;
+    size_t size;
+    double* values;
+    // CSR: the elements of row i are row_ptr[i] to row_ptr[i+1]-1. The
+    // other formats have one unused element, so every kernel can name them
+    int* row_ptr;
+    int* col_idx;
+    size_t rows_size;
+    size_t cols_size;
+} matrix;
+
+#pragma acc routine seq
+void mat_row_range(int format, int dim, int width, const int* row_ptr, int i, size_t* begin, size_t* end)
+{
+    /**
+     * Index of the first value of row i and of the one after the last
+     */
+    switch (format)
+    {
+    case MAT_DENSE:
+        *begin = (size_t) i*dim;
+        *end = *begin + dim;
+        break;
+    case MAT_CSR:
+        *begin = row_ptr[i];
+        *end = row_ptr[i+1];
+        break;
+    default:
+        *begin = (size_t) i*width;
+        *end = *begin + width;
+    }
+}
+
+#pragma acc routine seq
+int mat_column(int format, int dim, int lower, int width, const int* col_idx, int i, size_t v)
+{
+    /**
+     * Column of the value v of row i (outside [0, dim[ for the padding of the band)
+     */
+    switch (format)
+    {
+    case MAT_DENSE:
+        return (int) (v - (size_t) i*dim);
+    case MAT_CSR:
+        return col_idx[v];
+    default:
+        return i - lower + (int) (v - (size_t) i*width);
+    }
+}
+
+#pragma acc routine seq
+long mat_locate(int format, int dim, int lower, int width, const int* row_ptr, const int* col_idx, int i, int j)
+{
+    /**
+     * Index of the value of the element (i, j), or -1 if it is not stored
+     */
+    switch (format)
+    {
+    case MAT_DENSE:
+        return (long) i*dim + j;
+    case MAT_CSR:
+    {
+        // The columns of a row are sorted
+        int first = row_ptr[i], last = row_ptr[i+1];
+        while (first < last)
+        {
+            const int middle = (first + last) / 2;
+            if (col_idx[middle] < j)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        return first < row_ptr[i+1] && col_idx[first] == j ? first : -1;
+    }
+    default:
+    {
+        const int o = j - i + lower;
+        return o >= 0 && o < width ? (long) i*width + o : -1;
+    }
+    }
+}
+
+size_t mat_nonzeros(int dim, int ndiags, const int* offsets)
+{
+    /**
+     * Number of elements in the diagonals (dim^2 for a full matrix)
+     */
+    if (ndiags == 0)
+        return (size_t) dim*dim;
+    size_t nnz = 0;
+    for (int d=0; d < ndiags; ++d)
+        nnz += dim - abs(offsets[d]);
+    return nnz;
+}
+
+int mat_select(int dim, int ndiags, const int* offsets)
+{
+    /**
+     * Choose the format taking the least memory for a structure
+     * The band is preferred to CSR and to dense for the same size.
+     */
+    if (ndiags == 0)
+        return MAT_DENSE;
+    if (ndiags == 1 && offsets[0] == 0)
+        return MAT_DIAGONAL;
+    const int lower = offsets[0] < 0 ? -offsets[0] : 0;
+    const int upper = offsets[ndiags-1] > 0 ? offsets[ndiags-1] : 0;
+    const double dense = 8. * dim * dim;
+    const double banded = 8. * dim * (lower + upper + 1);
+    const double csr = 12. * mat_nonzeros(dim, ndiags, offsets) + 4. * (dim + 1);
+    if (banded <= csr && banded <= dense)
+        return MAT_BANDED;
+    return csr < dense ? MAT_CSR : MAT_DENSE;
+}
+
+void mat_build_csr(matrix* mat)
+{
+    /**
+     * Compute the rows and the columns of the elements of a CSR matrix from its diagonals
+     * The indices are computed on the host, before the copy to the device,
+     * so that mat_get finds the elements on the host too.
+     */
+    const int dim = mat->dim;
+    int* row_ptr = mat->row_ptr;
+    int* col_idx = mat->col_idx;
+    int p = 0;
+    for (int i=0; i < dim; ++i)
+    {
+        row_ptr[i] = p;
+        for (int d=0; d < mat->ndiags; ++d)
+        {
+            const int j = i + mat->offsets[d];
+            if (j >= 0 && j < dim)
+                col_idx[p++] = j;
+        }
+    }
+    row_ptr[dim] = p;
+}
+
+matrix* create_mat_format(int dim, int ndiags, const int* offsets, int format, int stream)
+{
+    /**
+     * Create a matrix in a given format
+     * @param dim: the number of rows and columns
+     * @param ndiags, offsets: the offsets j-i of the non zero diagonals in
+     *                         increasing order, ndiags = 0 for a full matrix
+     * @param format: MAT_DENSE, MAT_DIAGONAL (only offset 0), MAT_BANDED or MAT_CSR (not full)
+     * @param stream: the queue of the allocation on the device
+     * @return the matrix, NULL if the format cannot hold the structure
+     */
+    if ((format == MAT_DIAGONAL && (ndiags != 1 || offsets[0] != 0)) || (format != MAT_DENSE && ndiags == 0))
+    {
+        fprintf(stderr, "Error: a %s matrix cannot hold this structure\n", mat_format_names[format]);
+        return NULL;
+    }
+    matrix* mat = (matrix*) calloc(1, sizeof(matrix));
+    mat->format = format;
+    mat->dim = dim;
+    mat->queue = stream;
+    mat->ndiags = ndiags;
+    mat->offsets = (int*) malloc((ndiags > 0 ? ndiags : 1)*sizeof(int));
+    mat->diags = (double*) calloc(ndiags > 0 ? ndiags : 1, sizeof(double));
+    if (ndiags > 0)
+        memcpy(mat->offsets, offsets, ndiags*sizeof(int));
+    mat->lower = ndiags == 0 ? dim-1 : (offsets[0] < 0 ? -offsets[0] : 0);
+    mat->upper = ndiags == 0 ? dim-1 : (offsets[ndiags-1] > 0 ? offsets[ndiags-1] : 0);
+    mat->width = mat->lower + mat->upper + 1;
+    mat->nnz = mat_nonzeros(dim, ndiags, offsets);
+    switch (format)
+    {
+    case MAT_DENSE:
+        mat->size = (size_t) dim*dim;
+        break;
+    case MAT_CSR:
+        mat->size = mat->nnz;
+        break;
+    default:
+        mat->size = (size_t) dim*mat->width;
+    }
+    mat->values = (double*) malloc(mat->size*sizeof(double));
+    mat->rows_size = format == MAT_CSR ? (size_t) dim+1 : 1;
+    mat->cols_size = format == MAT_CSR ? mat->nnz : 1;
+    mat->row_ptr = (int*) calloc(mat->rows_size, sizeof(int));
+    mat->col_idx = (int*) calloc(mat->cols_size, sizeof(int));
+    if (format == MAT_CSR)
+        mat_build_csr(mat);
+    #pragma acc enter data copyin(mat->offsets[0:ndiags], mat->diags[0:ndiags], mat->row_ptr[0:mat->rows_size], mat->col_idx[0:mat->cols_size]) create(mat->values[0:mat->size]) async(stream)
+    return mat;
+}
+
+matrix* create_mat(int dim, int ndiags, const int* offsets, int stream)
+{
+    /**
+     * Create a matrix in the format taking the least memory for its structure
+     * @param dim: the number of rows and columns
+     * @param ndiags, offsets: the offsets j-i of the non zero diagonals in
+     *                         increasing order, ndiags = 0 for a full matrix
+     * @param stream: the queue of the allocation on the device
+     */
+    return create_mat_format(dim, ndiags, offsets, mat_select(dim, ndiags, offsets), stream);
+}
+
+int mat_compare_offsets(const void* a, const void* b)
+{
+    return *(const int*) a - *(const int*) b;
+}
+
+matrix* create_product(const matrix* A, const matrix* B, int stream)
+{
+    /**
+     * Create a matrix of the structure of A*B: its diagonals are the sums of
+     * the offsets of the diagonals of A and B, it is full if A or B is full
+     */
+    const int dim = A->dim;
+    if (A->ndiags == 0 || B->ndiags == 0)
+        return create_mat(dim, 0, NULL, stream);
+    int* offsets = (int*) malloc(A->ndiags*B->ndiags*sizeof(int));
+    int ndiags = 0;
+    for (int a=0; a < A->ndiags; ++a)
+        for (int b=0; b < B->ndiags; ++b)
+        {
+            const int o = A->offsets[a] + B->offsets[b];
+            if (o > -dim && o < dim)
+                offsets[ndiags++] = o;
+        }
+    qsort(offsets, ndiags, sizeof(int), mat_compare_offsets);
+    int unique = 0;
+    for (int d=0; d < ndiags; ++d)
+        if (unique == 0 || offsets[d] != offsets[unique-1])
+            offsets[unique++] = offsets[d];
+    matrix* C = create_mat(dim, unique, offsets, stream);
+    free(offsets);
+    return C;
+}
+
+void init_mat(matrix* mat, const double* diags, int stream)
+{
+    /**
+     * Set the elements of the diagonal offsets[d] to diags[d] and the other ones to 0
+     * The values are copied: diags can be freed at once.
+     * @param stream: the queue of the initialisation
+     */
+    const int dim = mat->dim;
+    const int format = mat->format;
+    const int lower = mat->lower;
+    const int width = mat->width;
+    const int ndiags = mat->ndiags;
+    const int* offsets = mat->offsets;
+    const int* row_ptr = mat->row_ptr;
+    const int* col_idx = mat->col_idx;
+    double* values = mat->values;
+    double* mat_diags = mat->diags;
+    const size_t size = mat->size;
+    mat->queue = stream;
+    if (ndiags > 0)
+        memcpy(mat_diags, diags, ndiags*sizeof(double));
+    #pragma acc update device(mat_diags[0:ndiags]) async(stream)
+    #pragma acc parallel loop present(values[0:size]) async(stream)
+    for (size_t v=0; v < size; ++v)
+        values[v] = 0.;
+    #pragma acc parallel loop collapse(2) present(values[0:size], offsets[0:ndiags], mat_diags[0:ndiags], row_ptr[0:mat->rows_size], col_idx[0:mat->cols_size]) async(stream)
+    for (int i=0; i < dim; ++i)
+        for (int d=0; d < ndiags; ++d)
+        {
+            const int j = i + offsets[d];
+            const long v = j >= 0 && j < dim ? mat_locate(format, dim, lower, width, row_ptr, col_idx, i, j) : -1;
+            if (v >= 0)
+                values[v] = mat_diags[d];
+        }
+}
+
+int mat_same_layout(const matrix* A, const matrix* B)
+{
+    /**
+     * Check if the values of A and B are stored at the same places
+     */
+    if (A->format != B->format || A->dim != B->dim || A->size != B->size)
+        return 0;
+    if (A->format == MAT_DENSE || A->format == MAT_DIAGONAL)
+        return 1;
+    if (A->format == MAT_BANDED)
+        return A->lower == B->lower && A->width == B->width;
+    return A->ndiags == B->ndiags && memcmp(A->offsets, B->offsets, A->ndiags*sizeof(int)) == 0;
+}
+
+void mat_scale_rows(const matrix* A, const matrix* B, matrix* C)
+{
+    /**
+     * C = A*B for a diagonal A: row i of B scaled by a_ii (C stored as B)
+     */
+    const int dim = B->dim;
+    const int format = B->format;
+    const int width = B->width;
+    const int* row_ptr = B->row_ptr;
+    const double* a = A->values;
+    const double* b = B->values;
+    double* c = C->values;
+#ifdef _OPENACC
+    #pragma acc parallel loop gang vector present(a[0:dim], b[0:B->size], c[0:B->size], row_ptr[0:B->rows_size]) wait(A->queue, B->queue, C->queue)
+#else
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int i=0; i < dim; ++i)
+    {
+        size_t begin, end;
+        mat_row_range(format, dim, width, row_ptr, i, &begin, &end);
+        for (size_t v=begin; v < end; ++v)
+            c[v] = a[i] * b[v];
+    }
+}
+
+void mat_scale_columns(const matrix* A, const matrix* B, matrix* C)
+{
+    /**
+     * C = A*B for a diagonal B: column j of A scaled by b_jj (C stored as A)
+     */
+    const int dim = A->dim;
+    const int format = A->format;
+    const int lower = A->lower;
+    const int width = A->width;
+    const int* row_ptr = A->row_ptr;
+    const int* col_idx = A->col_idx;
+    const double* a = A->values;
+    const double* b = B->values;
+    double* c = C->values;
+#ifdef _OPENACC
+    #pragma acc parallel loop gang vector present(a[0:A->size], b[0:dim], c[0:A->size], row_ptr[0:A->rows_size], col_idx[0:A->cols_size]) wait(A->queue, B->queue, C->queue)
+#else
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int i=0; i < dim; ++i)
+    {
+        size_t begin, end;
+        mat_row_range(format, dim, width, row_ptr, i, &begin, &end);
+        for (size_t v=begin; v < end; ++v)
+        {
+            const int j = mat_column(format, dim, lower, width, col_idx, i, v);
+            c[v] = j >= 0 && j < dim ? a[v] * b[j] : 0.;
+        }
+    }
+}
+
+void mat_multiply_banded(const matrix* A, const matrix* B, matrix* C)
+{
+    /**
+     * C = A*B for banded (or diagonal) matrices whose band holds the one of A*B
+     * c_ij is the sum over k in the bands of row i of A and column j of B.
+     */
+    const int dim = A->dim;
+    const int la = A->lower, ua = A->upper, wa = A->width;
+    const int lb = B->lower, ub = B->upper, wb = B->width;
+    const int lc = C->lower, wc = C->width;
+    const double* a = A->values;
+    const double* b = B->values;
+    double* c = C->values;
+#ifdef _OPENACC
+    #pragma acc parallel loop gang vector collapse(2) present(a[0:A->size], b[0:B->size], c[0:C->size]) wait(A->queue, B->queue, C->queue)
+#else
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int i=0; i < dim; ++i)
+        for (int oc=0; oc < wc; ++oc)
+        {
+            const int j = i - lc + oc;
+            int first = i - la > j - ub ? i - la : j - ub;
+            int last = i + ua < j + lb ? i + ua : j + lb;
+            first = first > 0 ? first : 0;
+            last = last < dim-1 ? last : dim-1;
+            double sum = 0.;
+            if (j >= 0 && j < dim)
+                for (int k=first; k <= last; ++k)
+                    sum += a[(size_t) i*wa + k-i+la] * b[(size_t) k*wb + j-k+lb];
+            c[(size_t) i*wc + oc] = sum;
+        }
+}
+
+void mat_multiply_dense(const matrix* A, const matrix* B, matrix* C)
+{
+    /**
+     * C = A*B for dense matrices, each element of C being computed by one thread
+     * The threads of a gang share the rows of A and the columns of B of their
+     * block of MAT_TILE x MAT_TILE elements, and read the rows of B contiguously.
+     */
+    const int dim = A->dim;
+    const double* a = A->values;
+    const double* b = B->values;
+    double* c = C->values;
+#ifdef _OPENACC
+    #pragma acc parallel loop gang collapse(2) present(a[:dim*dim], b[:dim*dim], c[:dim*dim]) wait(A->queue, B->queue, C->queue)
+    for (int ib=0; ib<dim; ib+=MAT_TILE)
+        for (int jb=0; jb<dim; jb+=MAT_TILE)
+        {
+            #pragma acc loop vector collapse(2)
+            for (int i=ib; i<ib+MAT_TILE; ++i)
+                for (int j=jb; j<jb+MAT_TILE; ++j)
+                {
+                    if (i < dim && j < dim)
+                    {
+                        double sum = 0.;
+                        #pragma acc loop seq
+                        for (int k=0; k<dim; ++k)
+                            sum += a[(size_t) i*dim+k] * b[(size_t) k*dim+j];
+                        c[(size_t) i*dim+j] = sum;
+                    }
+                }
+        }
+#else
+    memset(c, 0, (size_t) dim*dim*sizeof(double));
+    gemm_packed(dim, dim, dim, a, b, c);
+#endif
+}
+
+void mat_multiply_rows(const matrix* A, const matrix* B, matrix* C)
+{
+    /**
+     * C = A*B row by row for any formats (Gustavson)
+     * Row i of C is the sum of the rows k of B scaled by the non zero a_ik:
+     * the thread of row i adds the products to the elements of C it owns.
+     */
+    const int dim = A->dim;
+    const int fa = A->format, la = A->lower, wa = A->width;
+    const int fb = B->format, lb = B->lower, wb = B->width;
+    const int fc = C->format, lc = C->lower, wc = C->width;
+    const int *ra = A->row_ptr, *ca = A->col_idx;
+    const int *rb = B->row_ptr, *cb = B->col_idx;
+    const int *rc = C->row_ptr, *cc = C->col_idx;
+    const double* a = A->values;
+    const double* b = B->values;
+    double* c = C->values;
+#ifdef _OPENACC
+    #pragma acc parallel loop gang vector present(a[0:A->size], b[0:B->size], c[0:C->size], ra[0:A->rows_size], ca[0:A->cols_size], rb[0:B->rows_size], cb[0:B->cols_size], rc[0:C->rows_size], cc[0:C->cols_size]) wait(A->queue, B->queue, C->queue)
+#else
+    #pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (int i=0; i < dim; ++i)
+    {
+        size_t c_begin, c_end, a_begin, a_end;
+        mat_row_range(fc, dim, wc, rc, i, &c_begin, &c_end);
+        for (size_t v=c_begin; v < c_end; ++v)
+            c[v] = 0.;
+        mat_row_range(fa, dim, wa, ra, i, &a_begin, &a_end);
+        for (size_t va=a_begin; va < a_end; ++va)
+        {
+            const int k = mat_column(fa, dim, la, wa, ca, i, va);
+            if (a[va] == 0. || k < 0 || k >= dim)
+                continue;
+            size_t b_begin, b_end;
+            mat_row_range(fb, dim, wb, rb, k, &b_begin, &b_end);
+            for (size_t vb=b_begin; vb < b_end; ++vb)
+            {
+                const int j = mat_column(fb, dim, lb, wb, cb, k, vb);
+                const long vc = j >= 0 && j < dim ? mat_locate(fc, dim, lc, wc, rc, cc, i, j) : -1;
+                if (vc >= 0)
+                    c[vc] += a[va] * b[vb];
+            }
+        }
+    }
+}
+
+void mat_multiply(const matrix* A, const matrix* B, matrix* C)
+{
+    /**
+     * C = A*B with the kernel of the formats of A, B and C
+     * C must hold the structure of A*B (see create_product).
+     */
+    const int banded_a = A->format == MAT_BANDED || A->format == MAT_DIAGONAL;
+    const int banded_b = B->format == MAT_BANDED || B->format == MAT_DIAGONAL;
+    const int banded_c = C->format == MAT_BANDED || C->format == MAT_DIAGONAL;
+    if (A->format == MAT_DIAGONAL && mat_same_layout(B, C))
+        mat_scale_rows(A, B, C);
+    else if (B->format == MAT_DIAGONAL && mat_same_layout(A, C))
+        mat_scale_columns(A, B, C);
+    else if (banded_a && banded_b && banded_c && C->lower >= A->lower + B->lower && C->upper >= A->upper + B->upper)
+        mat_multiply_banded(A, B, C);
+    else if (A->format == MAT_DENSE && B->format == MAT_DENSE && C->format == MAT_DENSE)
+        mat_multiply_dense(A, B, C);
+    else
+        mat_multiply_rows(A, B, C);
+}
+
+double mat_checksum(const matrix* mat)
+{
+    /**
+     * Sum of the elements weighted by their position: sum of (i+1)(j+1) a_ij
+     * A plain sum would miss most errors on a matrix whose rows sum to 0
+     * (tridiagonal or 5-point Laplacian), and does not depend on the place
+     * of the elements. The result does not depend on the format.
+     */
+    const int dim = mat->dim;
+    const int format = mat->format;
+    const int lower = mat->lower;
+    const int width = mat->width;
+    const int* row_ptr = mat->row_ptr;
+    const int* col_idx = mat->col_idx;
+    const double* values = mat->values;
+    double sum = 0.;
+#ifdef _OPENACC
+    #pragma acc parallel loop reduction(+:sum) present(values[0:mat->size], row_ptr[0:mat->rows_size], col_idx[0:mat->cols_size]) wait(mat->queue)
+#else
+    #pragma omp parallel for reduction(+:sum)
+#endif
+    for (int i=0; i < dim; ++i)
+    {
+        size_t begin, end;
+        mat_row_range(format, dim, width, row_ptr, i, &begin, &end);
+        double row = 0.;
+        for (size_t v=begin; v < end; ++v)
+        {
+            const int j = mat_column(format, dim, lower, width, col_idx, i, v);
+            if (j >= 0 && j < dim)
+                row += (j + 1.) * values[v];
+        }
+        sum += (i + 1.) * row;
+    }
+    return sum;
+}
+
+void mat_update_self(matrix* mat)
+{
+    /**
+     * Copy the values of the matrix from the device to the host, after the
+     * kernels of its queue. The structure (offsets, row_ptr, col_idx) is
+     * built on the host and needs no copy.
+     */
+#ifndef _OPENACC
+    (void) mat;
+#endif
+    #pragma acc update self(mat->values[0:mat->size]) wait(mat->queue)
+}
+
+double mat_get(const matrix* mat, int i, int j)
+{
+    /**
+     * Element (i, j) on the host (after mat_update_self)
+     */
+    const long v = mat_locate(mat->format, mat->dim, mat->lower, mat->width, mat->row_ptr, mat->col_idx, i, j);
+    return v >= 0 ? mat->values[v] : 0.;
+}
+
+void free_mat(matrix* mat)
+{
+    #pragma acc wait(mat->queue)
+    #pragma acc exit data delete(mat->offsets[0:mat->ndiags], mat->diags[0:mat->ndiags], mat->values[0:mat->size], mat->row_ptr[0:mat->rows_size], mat->col_idx[0:mat->cols_size])
+    free(mat->offsets);
+    free(mat->diags);
+    free(mat->values);
+    free(mat->row_ptr);
+    free(mat->col_idx);
+    free(mat);
+}
+
+#endif
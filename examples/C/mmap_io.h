@@ -0,0 +1,98 @@
+#ifndef MMAP_IO_H
+#define MMAP_IO_H
+/**
+ * Memory mapped access to raw pictures (.rgb and .gray files)
+ *
+ * The kernels work directly on the pages of the file in the page cache:
+ * there is no read into (or write from) a separate buffer.
+ *
+ * List of functions:
+ *   - unsigned char* map_input(const char* path, size_t size)
+ *     map an existing file in read only mode
+ *   - unsigned char* map_output(const char* path, size_t size)
+ *     create (or truncate) a file of the given size and map it for writing
+ *   - void unmap(unsigned char* data, size_t size)
+ *     release a mapping. The data of an output file is written back by the system
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+unsigned char* map_input(const char* path, size_t size)
+{
+    /**
+     * Map a picture stored in a file
+     * @param path(in): the path of the file
+     * @param size(in): the number of bytes expected in the file
+     * @return a pointer to the picture or NULL in case of error
+     */
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < size || size == 0)
+    {
+        fprintf(stderr, "Error: %s does not contain %zu bytes\n", path, size);
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the file descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: cannot map %s\n", path);
+        return NULL;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    return (unsigned char*) data;
+}
+
+unsigned char* map_output(const char* path, size_t size)
+{
+    /**
+     * Create a file of size bytes and map it to store a picture
+     * @param path(in): the path of the file
+     * @param size(in): the size of the file in bytes
+     * @return a pointer to the picture or NULL in case of error
+     */
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: cannot create %s\n", path);
+        return NULL;
+    }
+    if (size == 0 || ftruncate(fd, (off_t) size) != 0)
+    {
+        fprintf(stderr, "Error: cannot set the size of %s to %zu bytes\n", path, size);
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: cannot map %s\n", path);
+        return NULL;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    return (unsigned char*) data;
+}
+
+void unmap(unsigned char* data, size_t size)
+{
+    /**
+     * Release a picture obtained with map_input or map_output
+     * @param data(in): the pointer returned by map_input or map_output
+     * @param size(in): the size given to map_input or map_output
+     */
+    if (data != NULL)
+        munmap(data, size);
+}
+#endif
@@ -2,38 +2,109 @@
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
-int main(void)
+#include "bench.h"
+
+// Integration of exp on [begin, end] by the trapezoidal rule
+typedef struct
 {
-    // current position and value
-    double x,y,x_p;
     // Number of divisions of the function
-    int nsteps = 1e9;
+    int nsteps;
     // x min
-    double begin = 0.;
-    // x max
-    double end = M_PI;
-    // Sum of elements
-    double sum = 0.;
+    double begin;
     // Length of the step
-    double step_l = (end-begin)/nsteps;
+    double step_l;
+    // Sum of elements and extrema of the function
+    double sum;
+    double dmin;
+    double dmax;
+} integral;
 
+void integrate_sequential(void* data)
+{
+    integral* p = (integral*) data;
+    const int nsteps = p->nsteps;
+    const double step_l = p->step_l;
+    double sum = 0.;
     double dmin = DBL_MAX;
     double dmax = DBL_MIN;
+    for (int i=0 ; i < nsteps ; ++i )
+    {
+        double x = i*step_l;
+        double x_p = (i+1)*step_l;
+        double y = (exp(x)+exp(x_p))/2;
+        sum += y;
+        if (y < dmin)
+            dmin = y;
+        if (y > dmax)
+            dmax = y;
+    }
+    p->sum = sum;
+    p->dmin = dmin;
+    p->dmax = dmax;
+}
+
+void integrate_parallel(void* data)
+{
+    integral* p = (integral*) data;
+    const int nsteps = p->nsteps;
+    const double step_l = p->step_l;
+    double sum = 0.;
+    double dmin = DBL_MAX;
+    double dmax = DBL_MIN;
+#ifdef _OPENACC
 #pragma acc parallel loop reduction(+:sum) reduction(min:dmin) reduction(max:dmax)
+#else
+#pragma omp parallel for reduction(+:sum) reduction(min:dmin) reduction(max:dmax)
+#endif
     for (int i=0 ; i < nsteps ; ++i )
     {
-        x = i*step_l;
-        x_p = (i+1)*step_l;
-        y = (exp(x)+exp(x_p))/2;
+        double x = i*step_l;
+        double x_p = (i+1)*step_l;
+        double y = (exp(x)+exp(x_p))/2;
         sum += y;
         if (y < dmin)
             dmin = y;
         if (y > dmax)
             dmax = y;
     }
+    p->sum = sum;
+    p->dmin = dmin;
+    p->dmax = dmax;
+}
+
+double check_integral(void* data)
+{
+    integral* p = (integral*) data;
+    return p->sum*p->step_l;
+}
+
+int main(int argc, char** argv)
+{
+    // Arguments: [nsteps] and the options of the benchmark (csv, json, warmup=N, reps=N)
+    int nsteps = 1e9;
+    bench bench;
+    bench_init(&bench, "integral of exp");
+    for (int arg=1; arg < argc; ++arg)
+        if (!bench_option(&bench, argv[arg]))
+            nsteps = atoi(argv[arg]);
+    // x min
+    double begin = 0.;
+    // x max
+    double end = M_PI;
+    integral sequential = {nsteps, begin, (end-begin)/nsteps, 0., 0., 0.};
+    integral parallel = sequential;
+
+    // The order of the additions differs between the variants
+    bench.tolerance = 1.e-9;
+    // One step: 5 flops (2 multiplications, 2 additions and a division), the 2
+    // exponentials are not counted
+    bench_add(&bench, "sequential", NULL, integrate_sequential, check_integral, &sequential, 5.*nsteps, 0.);
+    bench_add(&bench, "parallel reduction", NULL, integrate_parallel, check_integral, &parallel, 5.*nsteps, 0.);
+    bench_run(&bench);
+
     // Print the stats
-    printf("The MINimum value of the function is: %f\n",dmin);
-    printf("The MAXimum value of the function is: %f\n",dmax);
-    printf("The integral of the function on [%f,%f] is: %f\n",begin,end,sum*step_l);
-    printf("   difference is: %5.2e",exp(end)-exp(begin)-sum*step_l);
+    printf("The MINimum value of the function is: %f\n",parallel.dmin);
+    printf("The MAXimum value of the function is: %f\n",parallel.dmax);
+    printf("The integral of the function on [%f,%f] is: %f\n",begin,end,parallel.sum*parallel.step_l);
+    printf("   difference is: %5.2e\n",exp(end)-exp(begin)-parallel.sum*parallel.step_l);
 }
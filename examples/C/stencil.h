@@ -0,0 +1,152 @@
+/**
+ * Generic 2D stencil
+ *
+ * This header is a template: define the parameters of the stencil then
+ * include it. It can be included several times to create several filters.
+ *
+ * Parameters:
+ *   - STENCIL_NAME: prefix of the generated functions
+ *   - STENCIL_TYPE: type of the elements of the input
+ *   - STENCIL_OUT_TYPE: type of the elements of the output (default STENCIL_TYPE)
+ *   - STENCIL_ACC_TYPE: type of the weighted sum (default int)
+ *   - STENCIL_RADIUS: the neighbourhood is (2*STENCIL_RADIUS+1)^2 pixels
+ *   - STENCIL_CHANNELS: number of interleaved channels of a pixel (3 for .rgb)
+ *   - STENCIL_COEFS: initializer of the (2*STENCIL_RADIUS+1)^2 coefficients
+ *   - STENCIL_FINALIZE(sum, center): the output for the weighted sum of the
+ *     neighbourhood and the value of the element itself
+ *   - STENCIL_ASYNC (optional): OpenACC queue used by the kernels
+ *   - STENCIL_HOST (optional): always run NAME_rows on the host, even when
+ *     compiled with OpenACC, for the programs which keep their pictures in
+ *     the host memory
+ *
+ * Compiled with OpenACC and without STENCIL_HOST, NAME_rows and NAME run on
+ * the device: in and out must already be present there (enter data or data
+ * region of the caller), they are not copied by the kernel.
+ *
+ * Generated functions:
+ *   - void NAME_rows(const TYPE* in, OUT_TYPE* out, size_t r0, size_t r1,
+ *                    size_t c0, size_t c1, size_t cols)
+ *     apply the stencil to the rows [r0, r1[ and the columns [c0, c1[
+ *     of a picture with cols pixels per row
+ *   - void NAME_block(const TYPE* in, OUT_TYPE* out, size_t r0, size_t r1,
+ *                     size_t c0, size_t c1, size_t cols)
+ *     same as NAME_rows without parallel loop, for a block small enough to
+ *     stay in the cache, computed by one thread of a parallel region
+ *   - void NAME(const TYPE* in, OUT_TYPE* out, size_t rows, size_t cols)
+ *     apply the stencil to the whole picture. The border of STENCIL_RADIUS
+ *     pixels, where the neighbourhood is incomplete, is not written.
+ *
+ * The coefficients are known at compile time: the loops over the
+ * neighbourhood are unrolled, null coefficients disappear and the loop over
+ * the elements of a row is vectorised.
+ */
+#include <stddef.h>
+
+#ifndef STENCIL_OUT_TYPE
+#define STENCIL_OUT_TYPE STENCIL_TYPE
+#endif
+#ifndef STENCIL_ACC_TYPE
+#define STENCIL_ACC_TYPE int
+#endif
+
+#define STENCIL_CAT_(a, b) a##b
+#define STENCIL_CAT(a, b) STENCIL_CAT_(a, b)
+#define STENCIL_WIDTH (2*STENCIL_RADIUS+1)
+
+void STENCIL_CAT(STENCIL_NAME, _rows)(const STENCIL_TYPE* restrict in, STENCIL_OUT_TYPE* restrict out,
+                                      size_t r0, size_t r1, size_t c0, size_t c1, size_t cols)
+{
+    /**
+     * Apply the stencil to a part of the picture
+     * @param in(in): a pointer to the original picture
+     * @param out(out): a pointer to the filtered picture
+     * @param r0, r1(in): the range of rows [r0, r1[ to compute
+     * @param c0, c1(in): the range of columns [c0, c1[ to compute
+     * @param cols(in): the number of columns in the picture
+     */
+    const size_t stride = STENCIL_CHANNELS*cols;
+    if (r0 >= r1 || c0 >= c1)
+        return;
+#if defined(_OPENACC) && !defined(STENCIL_HOST)
+#ifdef STENCIL_ASYNC
+#pragma acc parallel loop present(in[(r0-STENCIL_RADIUS)*stride:(r1-r0+2*STENCIL_RADIUS)*stride], \
+                                  out[r0*stride:(r1-r0)*stride]) async(STENCIL_ASYNC)
+#else
+#pragma acc parallel loop present(in[(r0-STENCIL_RADIUS)*stride:(r1-r0+2*STENCIL_RADIUS)*stride], \
+                                  out[r0*stride:(r1-r0)*stride])
+#endif
+#else
+#pragma omp parallel for schedule(static)
+#endif
+    for (size_t i=r0; i<r1; ++i)
+    {
+        const STENCIL_ACC_TYPE coefs[STENCIL_WIDTH][STENCIL_WIDTH] = STENCIL_COEFS;
+#pragma acc loop vector
+#pragma omp simd
+        for (size_t j=c0*STENCIL_CHANNELS; j<c1*STENCIL_CHANNELS; ++j)
+        {
+            STENCIL_ACC_TYPE sum = 0;
+#pragma acc loop seq
+            for (int di=0; di<STENCIL_WIDTH; ++di)
+#pragma acc loop seq
+                for (int dj=0; dj<STENCIL_WIDTH; ++dj)
+                    sum += coefs[di][dj] * in[(i+di-STENCIL_RADIUS)*stride + j
+                                              + (dj-STENCIL_RADIUS)*STENCIL_CHANNELS];
+            out[i*stride+j] = STENCIL_FINALIZE(sum, in[i*stride+j]);
+        }
+    }
+}
+
+void STENCIL_CAT(STENCIL_NAME, _block)(const STENCIL_TYPE* restrict in, STENCIL_OUT_TYPE* restrict out,
+                                       size_t r0, size_t r1, size_t c0, size_t c1, size_t cols)
+{
+    /**
+     * Apply the stencil to a block of the picture on the host (one thread)
+     * @param in(in): a pointer to the original picture
+     * @param out(out): a pointer to the filtered picture
+     * @param r0, r1(in): the range of rows [r0, r1[ to compute
+     * @param c0, c1(in): the range of columns [c0, c1[ to compute
+     * @param cols(in): the number of columns in the picture
+     */
+    const size_t stride = STENCIL_CHANNELS*cols;
+    const STENCIL_ACC_TYPE coefs[STENCIL_WIDTH][STENCIL_WIDTH] = STENCIL_COEFS;
+    for (size_t i=r0; i<r1; ++i)
+    {
+#pragma omp simd
+        for (size_t j=c0*STENCIL_CHANNELS; j<c1*STENCIL_CHANNELS; ++j)
+        {
+            STENCIL_ACC_TYPE sum = 0;
+            for (int di=0; di<STENCIL_WIDTH; ++di)
+                for (int dj=0; dj<STENCIL_WIDTH; ++dj)
+                    sum += coefs[di][dj] * in[(i+di-STENCIL_RADIUS)*stride + j
+                                              + (dj-STENCIL_RADIUS)*STENCIL_CHANNELS];
+            out[i*stride+j] = STENCIL_FINALIZE(sum, in[i*stride+j]);
+        }
+    }
+}
+
+void STENCIL_NAME(const STENCIL_TYPE* restrict in, STENCIL_OUT_TYPE* restrict out, size_t rows, size_t cols)
+{
+    /**
+     * Apply the stencil to the inner part of the picture
+     * @param in(in): a pointer to the original picture
+     * @param out(out): a pointer to the filtered picture
+     * @param rows(in): the number of rows in the picture
+     * @param cols(in): the number of columns in the picture
+     */
+    if (rows > 2*STENCIL_RADIUS && cols > 2*STENCIL_RADIUS)
+        STENCIL_CAT(STENCIL_NAME, _rows)(in, out, STENCIL_RADIUS, rows-STENCIL_RADIUS,
+                                         STENCIL_RADIUS, cols-STENCIL_RADIUS, cols);
+}
+
+#undef STENCIL_NAME
+#undef STENCIL_TYPE
+#undef STENCIL_OUT_TYPE
+#undef STENCIL_ACC_TYPE
+#undef STENCIL_RADIUS
+#undef STENCIL_CHANNELS
+#undef STENCIL_COEFS
+#undef STENCIL_FINALIZE
+#undef STENCIL_ASYNC
+#undef STENCIL_HOST
+#undef STENCIL_WIDTH